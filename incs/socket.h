@@ -0,0 +1 @@
+/root/repo/library/utils/utils/socket.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/library/utils/utils/utils.h
\ No newline at end of file
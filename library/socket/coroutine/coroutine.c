@@ -0,0 +1,473 @@
+#include "coroutine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <utils/utils.h>
+#include <bsem/bsem.h>
+#else
+#pragma comment(lib, "Ws2_32.lib")
+#include <WinSock2.h>
+#include <windows.h>
+#include "utils.h"
+#include "bsem.h"
+#endif
+
+typedef enum co_state_t co_state_t;
+enum co_state_t {
+    /**
+     * body is running on a worker
+     */
+    CO_RUNNING  = 0,
+
+    /**
+     * woken up while body still running, runs again once it returns
+     */
+    CO_NOTIFIED = 1,
+
+    /**
+     * suspended, first wake up schedules body
+     */
+    CO_WAITING  = 2,
+
+    /**
+     * body returned CO_DONE
+     */
+    CO_FINISHED = 3,
+};
+
+typedef struct private_coroutine_t private_coroutine_t;
+struct private_coroutine_t {
+    /**
+     * @brief public interface
+     */
+    coroutine_t public;
+
+    /**
+     * @brief pool running body
+     */
+    pool_t *pool;
+
+    /**
+     * @brief event waking up await_fd
+     */
+    event_t *event;
+
+    /**
+     * @brief body and its parameter
+     */
+    coroutine_fn_t fn;
+    void *arg;
+
+    /**
+     * @brief co_state_t
+     */
+    int state;
+
+    /**
+     * @brief result of last await
+     */
+    int result;
+
+    /**
+     * @brief one for the handle, one until body done
+     */
+    int refs;
+
+    /**
+     * @brief posted when body done
+     */
+    bsem_t *done;
+};
+
+/**
+ * One await of a coroutine, shared by its wake up sources, the first
+ * source to claim it resumes the coroutine, the others only let go.
+ */
+typedef struct co_wait_t co_wait_t;
+struct co_wait_t {
+    /**
+     * @brief coroutine waiting
+     */
+    private_coroutine_t *co;
+
+    /**
+     * @brief one per wake up source, one while await sets up
+     */
+    int refs;
+
+    /**
+     * @brief set by first wake up source
+     */
+    int claimed;
+
+    /**
+     * @brief socket and event types registered, 0 once unregistered
+     */
+    SOCKET fd;
+    int types;
+
+    /**
+     * @brief timeout timer, NULL if none, and result of await when it
+     *        fires first
+     */
+    pool_timer_t *timer;
+    int timer_result;
+
+    /**
+     * @brief [out] result of awaited future
+     */
+    void **value;
+};
+
+static void co_run(private_coroutine_t *this);
+
+/**
+ * @brief give handle or run reference back, free at last
+ */
+static void co_unref(private_coroutine_t *this)
+{
+    if (ATOMIC_SUB(&this->refs, 1) > 0) return;
+
+    if (this->done) this->done->destroy(this->done);
+    free(this);
+}
+
+/**
+ * @brief schedule suspended body on pool, or mark running one to run again
+ */
+static void co_wake(private_coroutine_t *this)
+{
+    int state = ATOMIC_LOAD(&this->state);
+
+    while (1) {
+        if (state == CO_RUNNING) {
+            if (ATOMIC_CAS(&this->state, &state, CO_NOTIFIED)) return;
+        } else if (state == CO_WAITING) {
+            if (ATOMIC_CAS(&this->state, &state, CO_RUNNING)) break;
+        } else {
+            return;
+        }
+    }
+
+    /**
+     * pool full, resume in thread of wake up source
+     */
+    if (this->pool->addjob(this->pool, (void *)co_run, this) != 0) co_run(this);
+}
+
+/**
+ * @brief task handler of coroutine, runs body until it suspends with no
+ *        wake up pending, or is done
+ */
+static void co_run(private_coroutine_t *this)
+{
+    int state = 0;
+
+    while (1) {
+        if (this->fn(&this->public, this->arg) == CO_DONE) {
+            ATOMIC_STORE(&this->state, CO_FINISHED);
+            this->done->post(this->done);
+            co_unref(this);
+            return;
+        }
+
+        state = CO_RUNNING;
+        if (ATOMIC_CAS(&this->state, &state, CO_WAITING)) return;
+        ATOMIC_STORE(&this->state, CO_RUNNING);
+    }
+}
+
+/**
+ * @brief let go of await, free at last
+ */
+static void co_wait_unref(co_wait_t *this)
+{
+    if (ATOMIC_SUB(&this->refs, 1) > 0) return;
+
+    if (this->timer) this->timer->destroy(this->timer);
+    free(this);
+}
+
+/**
+ * @brief unregister event types of await, by the one taking them
+ */
+static void co_wait_unregister(co_wait_t *this)
+{
+    event_t *event = this->co->event;
+    int types = ATOMIC_XCHG(&this->types, 0), type = 0;
+
+    if (!types) return;
+    for (type = EVENT_ON_ACCEPT; type <= EVENT_ON_WRITABLE; type <<= 1) {
+        if (types & type) event->delete(event, this->fd, type);
+    }
+    co_wait_unref(this);
+}
+
+/**
+ * @brief claim await for a wake up source, stop the other sources
+ *
+ * @param result  result of await seen by body
+ * @return        1 if claimed, 0 if another source was first
+ */
+static int co_wait_claim(co_wait_t *this, int result)
+{
+    pool_timer_t *timer = NULL;
+
+    if (ATOMIC_XCHG(&this->claimed, 1)) return 0;
+
+    this->co->result = result;
+    timer = ATOMIC_LOAD(&this->timer);
+    if (timer && timer->cancel(timer) == 0) co_wait_unref(this);
+    co_wait_unregister(this);
+
+    return 1;
+}
+
+/**
+ * @brief event handler of await_fd, runs in event thread
+ */
+static void co_fd_ready(SOCKET fd, void *arg)
+{
+    co_wait_t *this = arg;
+    private_coroutine_t *co = this->co;
+
+    /**
+     * registration reference goes with unregister, hold await till done
+     */
+    ATOMIC_ADD(&this->refs, 1);
+    co_wait_unregister(this);
+    if (co_wait_claim(this, 0)) co_wake(co);
+    co_wait_unref(this);
+}
+
+/**
+ * @brief timer job of await timeout or sleep, runs on pool
+ */
+static void co_timer_fired(co_wait_t *this)
+{
+    private_coroutine_t *co = this->co;
+
+    if (co_wait_claim(this, this->timer_result)) co_wake(co);
+    co_wait_unref(this);
+}
+
+/**
+ * @brief continuation of awaited future, runs on pool
+ */
+static void *co_future_done(void *arg, void *result)
+{
+    co_wait_t *this = arg;
+    private_coroutine_t *co = this->co;
+
+    if (co_wait_claim(this, 0)) {
+        if (this->value) *this->value = result;
+        co_wake(co);
+    }
+    co_wait_unref(this);
+
+    return NULL;
+}
+
+/**
+ * @brief new await of coroutine, referenced by setup only
+ */
+static co_wait_t *co_wait_create(private_coroutine_t *co)
+{
+    co_wait_t *this = calloc(1, sizeof(co_wait_t));
+
+    if (!this) return NULL;
+    this->co   = co;
+    this->refs = 1;
+
+    return this;
+}
+
+/**
+ * @brief start timer of await, no timer if it fails
+ *
+ * @param result  result of await if timer fires first
+ */
+static void co_wait_timer(co_wait_t *this, unsigned int delay, int result)
+{
+    pool_t *pool = this->co->pool;
+
+    this->timer_result = result;
+    ATOMIC_ADD(&this->refs, 1);
+    ATOMIC_STORE(&this->timer, pool->addjob_after(pool, delay, (void *)co_timer_fired, this));
+    if (!this->timer) ATOMIC_SUB(&this->refs, 1);
+}
+
+METHOD(coroutine_t, await_fd_, int, private_coroutine_t *this, SOCKET fd, int types, unsigned int timeout)
+{
+    co_wait_t *wait = NULL;
+    int type = 0;
+
+    this->result = -1;
+    types &= EVENT_ON_ACCEPT | EVENT_ON_CONNECT | EVENT_ON_RECV | EVENT_ON_CLOSE | EVENT_ON_WRITABLE;
+    if (!this->event || !types) return -1;
+    wait = co_wait_create(this);
+    if (!wait) return -1;
+    wait->fd = fd;
+
+    /**
+     * all types share one reference, dropped by whoever unregisters
+     */
+    ATOMIC_ADD(&wait->refs, 1);
+    ATOMIC_STORE(&wait->types, types);
+    for (type = EVENT_ON_ACCEPT; type <= EVENT_ON_WRITABLE; type <<= 1) {
+        if (!(types & type)) continue;
+        if (this->event->add(this->event, fd, type, co_fd_ready, wait) != 0) {
+            co_wait_unregister(wait);
+            co_wait_unref(wait);
+            return -1;
+        }
+    }
+
+    /**
+     * fd ready before all types were added, drop the late ones again
+     */
+    if (ATOMIC_LOAD(&wait->claimed)) {
+        for (type = EVENT_ON_ACCEPT; type <= EVENT_ON_WRITABLE; type <<= 1) {
+            if (types & type) this->event->delete(this->event, fd, type);
+        }
+    } else if (timeout > 0) {
+        co_wait_timer(wait, timeout, -1);
+    }
+    co_wait_unref(wait);
+
+    return 0;
+}
+
+METHOD(coroutine_t, await_future_, int, private_coroutine_t *this, future_t *future, void **result)
+{
+    co_wait_t *wait = NULL;
+    future_t *cont = NULL;
+
+    this->result = -1;
+    if (!future) return -1;
+    wait = co_wait_create(this);
+    if (!wait) return -1;
+    wait->value = result;
+
+    ATOMIC_ADD(&wait->refs, 1);
+    cont = future->then(future, co_future_done, wait);
+    if (!cont) {
+        co_wait_unref(wait);
+        co_wait_unref(wait);
+        return -1;
+    }
+    cont->destroy(cont);
+    co_wait_unref(wait);
+
+    return 0;
+}
+
+METHOD(coroutine_t, sleep_, int, private_coroutine_t *this, unsigned int delay)
+{
+    co_wait_t *wait = NULL;
+
+    this->result = -1;
+    wait = co_wait_create(this);
+    if (!wait) return -1;
+
+    co_wait_timer(wait, delay, 0);
+    if (!wait->timer) {
+        co_wait_unref(wait);
+        return -1;
+    }
+    co_wait_unref(wait);
+
+    return 0;
+}
+
+METHOD(coroutine_t, result_, int, private_coroutine_t *this)
+{
+    return this->result;
+}
+
+METHOD(coroutine_t, is_done_, int, private_coroutine_t *this)
+{
+    return ATOMIC_LOAD(&this->state) == CO_FINISHED;
+}
+
+METHOD(coroutine_t, wait_, void, private_coroutine_t *this)
+{
+    /**
+     * pass done on to the next waiter
+     */
+    this->done->wait(this->done);
+    this->done->post(this->done);
+}
+
+METHOD(coroutine_t, destroy_, void, private_coroutine_t *this)
+{
+    co_unref(this);
+}
+
+coroutine_t *coroutine_create(pool_t *pool, event_t *event, coroutine_fn_t fn, void *arg)
+{
+    private_coroutine_t *this;
+
+    if (!pool || !fn) return NULL;
+
+#ifndef _WIN32
+    INIT(this,
+        .public = {
+            .await_fd     = _await_fd_,
+            .await_future = _await_future_,
+            .sleep        = _sleep_,
+            .result       = _result_,
+            .is_done      = _is_done_,
+            .wait         = _wait_,
+            .destroy      = _destroy_,
+            .line         = 0,
+        },
+        .pool   = pool,
+        .event  = event,
+        .fn     = fn,
+        .arg    = arg,
+        .state  = CO_RUNNING,
+        .result = 0,
+        .refs   = 2,
+        .done   = bsem_create(0),
+    );
+#else
+    INIT(this, private_coroutine_t,
+        {
+            await_fd_,
+            await_future_,
+            sleep_,
+            result_,
+            is_done_,
+            wait_,
+            destroy_,
+            0,
+        },
+        pool,
+        event,
+        fn,
+        arg,
+        CO_RUNNING,
+        0,
+        2,
+        bsem_create(0),
+    );
+#endif
+    if (!this) return NULL;
+    if (!this->done) {
+        free(this);
+        return NULL;
+    }
+
+    /**
+     * first run from the top on a worker
+     */
+    if (pool->addjob(pool, (void *)co_run, this) != 0) {
+        this->done->destroy(this->done);
+        free(this);
+        return NULL;
+    }
+
+    return &this->public;
+}
@@ -0,0 +1,121 @@
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#ifndef _WIN32
+#include <pool/pool.h>
+#include <event/event.h>
+#else
+#include "pool.h"
+#include "event.h"
+#endif
+
+/**
+ * return values of coroutine body
+ */
+#define CO_WAIT 0
+#define CO_DONE 1
+
+/**
+ * Body of a coroutine is a plain function entered again from the top on
+ * every resume, CO_BEGIN jumps back to the CO_AWAIT it suspended at.
+ * Locals do not survive a suspend, keep state in arg. At most one
+ * CO_AWAIT per source line, and none inside a switch of the body.
+ *
+ *     CO_BEGIN(co);
+ *     while (conn->left > 0) {
+ *         CO_AWAIT(co, co->await_fd(co, conn->fd, EVENT_ON_RECV | EVENT_ON_CLOSE, 5000));
+ *         if (co->result(co) != 0) break;
+ *         conn->left -= recv(conn->fd, conn->buf, sizeof(conn->buf), 0);
+ *     }
+ *     CO_END(co);
+ */
+#define CO_BEGIN(co) switch ((co)->line) { case 0:
+#define CO_END(co)   } return CO_DONE
+
+/**
+ * suspend until call is done, call is one of the await methods, its
+ * result is read by co->result(co) after, goes on at once if call failed
+ */
+#define CO_AWAIT(co, call) \
+    do { \
+        (co)->line = __LINE__; \
+        if ((call) == 0) return CO_WAIT; \
+        case __LINE__:; \
+    } while (0)
+
+typedef struct coroutine_t coroutine_t;
+
+/**
+ * @brief body of coroutine
+ * @return      CO_DONE when finished, CO_WAIT when suspended by CO_AWAIT
+ */
+typedef int (*coroutine_fn_t) (coroutine_t *co, void *arg);
+
+/**
+ * Stackless coroutine, its body runs on pool workers, one at a time,
+ * and does not hold a thread while suspended.
+ */
+struct coroutine_t {
+    /**
+     * @brief suspend until fd is ready, used by CO_AWAIT
+     * @param fd       socket
+     * @param types    event_type_t combination, first of them wakes up
+     * @param timeout  timeout in ms, 0 for ever
+     * @return         0 if suspended, -1 if failed
+     */
+    int (*await_fd) (coroutine_t *this, SOCKET fd, int types, unsigned int timeout);
+
+    /**
+     * @brief suspend until job of future done, used by CO_AWAIT, future
+     *        handle still belongs to caller
+     * @param result   [out] result of job, can be NULL, must outlive
+     *                 suspend, like a field of arg
+     * @return         0 if suspended, -1 if failed
+     */
+    int (*await_future) (coroutine_t *this, future_t *future, void **result);
+
+    /**
+     * @brief suspend for delay in ms, used by CO_AWAIT
+     * @return         0 if suspended, -1 if failed
+     */
+    int (*sleep) (coroutine_t *this, unsigned int delay);
+
+    /**
+     * @brief result of last await
+     * @return         0 if ready, -1 if timed out or failed
+     */
+    int (*result) (coroutine_t *this);
+
+    /**
+     * @brief whether body returned CO_DONE, never blocks
+     */
+    int (*is_done) (coroutine_t *this);
+
+    /**
+     * @brief wait until body returned CO_DONE, not from its own body
+     */
+    void (*wait) (coroutine_t *this);
+
+    /**
+     * @brief give handle back, coroutine still runs until done, one
+     *        waiting for ever is never freed
+     */
+    void (*destroy) (coroutine_t *this);
+
+    /**
+     * @brief resume point, only for CO_ macros
+     */
+    int line;
+};
+
+/**
+ * @brief create coroutine and start it on pool
+ * @param pool     pool running body
+ * @param event    event waking up await_fd, can be NULL if not used
+ * @param fn       body
+ * @param arg      parameter of body, keeps state across suspends
+ * @return         coroutine, NULL if failed
+ */
+coroutine_t *coroutine_create(pool_t *pool, event_t *event, coroutine_fn_t fn, void *arg);
+
+#endif /* __COROUTINE_H__ */
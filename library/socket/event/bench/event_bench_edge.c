@@ -0,0 +1,130 @@
+/**
+ * level against edge triggered epoll on many AF_UNIX socketpairs, one
+ * producer writes bursts of small messages to every connection, loop
+ * handler reads either once per call or until EAGAIN
+ *
+ * usage: event_bench_edge [connections] [rounds]
+ */
+#include "../event.c"
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define BURST    4
+#define MSG_SIZE 64
+
+enum {
+    LEVEL_ONE_READ = 0,
+    LEVEL_DRAIN,
+    EDGE_DRAIN,
+};
+
+static const char *mode_names[] = {"level, one read", "level, drain", "edge, drain"};
+
+static int mode;
+static long bytes, calls, waits, events;
+
+int __real_epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout);
+
+/**
+ * linked with --wrap=epoll_wait, counts returns with events
+ */
+int __wrap_epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout)
+{
+    int ret = __real_epoll_wait(epfd, evs, maxevents, timeout);
+
+    if (ret > 0) {
+        __atomic_add_fetch(&waits, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&events, ret, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+static void on_recv(SOCKET fd, void *arg)
+{
+    char buf[4096];
+    ssize_t n = 0;
+
+    __atomic_add_fetch(&calls, 1, __ATOMIC_RELAXED);
+    do {
+        n = read(fd, buf, mode == LEVEL_ONE_READ ? MSG_SIZE : sizeof(buf));
+        if (n > 0) __atomic_add_fetch(&bytes, n, __ATOMIC_RELAXED);
+    } while (mode != LEVEL_ONE_READ && n > 0);
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time()
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    int conns  = argc > 1 ? atoi(argv[1]) : 10000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 40;
+    char msg[MSG_SIZE] = {0};
+    struct rlimit rl;
+    event_t *loop = NULL;
+    double start = 0, cpu = 0;
+    long total = (long)conns * rounds * BURST * MSG_SIZE;
+    int *fds = NULL;
+    int i = 0, r = 0, b = 0;
+
+    /**
+     * two fds per connection
+     */
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    fds = malloc(sizeof(int) * 2 * conns);
+    if (!fds) return 1;
+    for (i = 0; i < conns; i++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds + 2 * i) != 0) {
+            printf("socketpair %d failed, raise fd limit or use fewer connections\n", i);
+            return 1;
+        }
+        fcntl(fds[2 * i], F_SETFL, fcntl(fds[2 * i], F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    for (mode = LEVEL_ONE_READ; mode <= EDGE_DRAIN; mode++) {
+        loop = event_create_ext(50, EVENT_BACKEND_EPOLL);
+        if (!loop) return 1;
+        for (i = 0; i < conns; i++) {
+            loop->add(loop, fds[2 * i], EVENT_ON_RECV | (mode == EDGE_DRAIN ? EVENT_EDGE : 0), on_recv, NULL);
+        }
+        usleep(100000);
+
+        bytes = calls = waits = events = 0;
+        start = now();
+        cpu   = cpu_time();
+        for (r = 0; r < rounds; r++) {
+            for (i = 0; i < conns; i++) {
+                for (b = 0; b < BURST; b++) {
+                    if (write(fds[2 * i + 1], msg, MSG_SIZE) != MSG_SIZE) return 1;
+                }
+            }
+            sched_yield();
+        }
+        while (__atomic_load_n(&bytes, __ATOMIC_ACQUIRE) < total) sched_yield();
+
+        printf("%-16s conns %d msgs %ld: %.3f s, cpu %.3f s, epoll_wait returns %ld, events %ld, handler calls %ld\n",
+               mode_names[mode], conns, total / MSG_SIZE, now() - start, cpu_time() - cpu, waits, events, calls);
+        loop->destroy(loop);
+    }
+
+    for (i = 0; i < 2 * conns; i++) close(fds[i]);
+    free(fds);
+
+    return 0;
+}
@@ -1,3 +1,6 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
 #ifdef _WIN32 
 #pragma comment(lib, "Ws2_32.lib")
 #include <WinSock2.h>
@@ -6,7 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <signal.h>
+#include <errno.h>
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -15,17 +18,31 @@
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <thread/thread.h>
+#include <mutex/mutex.h>
 #include <utils/utils.h>
 #include <linked_list/linked_list.h>
+#include <tcp/tcp.h>
 #else
 #include <windows.h>
 #include "utils.h"
 #include "thread.h"
+#include "mutex.h"
 #include "linked_list.h"
+#include "tcp.h"
 #endif
 
 #define DFT_MAX_EVT_SIZE 4
+
+/**
+ * ready fds taken by one epoll_wait, and first size of fd table
+ */
+#define DFT_EPOLL_EVENTS 256
+#define DFT_EPOLL_FDS    1024
 typedef struct event_pkg_t event_pkg_t;
 struct event_pkg_t {
     /**
@@ -47,6 +64,16 @@ struct event_pkg_t {
      * @brief callback function parameter
      */
     void *arg;
+
+    /**
+     * @brief next type of same fd, epoll only
+     */
+    event_pkg_t *next;
+
+    /**
+     * @brief added with EVENT_EDGE, epoll only
+     */
+    int edge;
 };
 
 typedef struct callback_t callback_t;
@@ -118,8 +145,57 @@ struct private_event_t {
      * @brief evt_index
      */
     int evt_index;
+
+    /**
+     * @brief event_backend_t in use, select or epoll
+     */
+    int backend;
+
+    /**
+     * @brief epoll instance, -1 for select
+     */
+    int epfd;
+
+    /**
+     * @brief packages indexed by fd, chained by type, epoll only
+     */
+    event_pkg_t **fds;
+    int fd_cap;
+
+    /**
+     * @brief set to stop event thread
+     */
+    int stop;
+
+    /**
+     * @brief guards registrations, fd sets, fd table and posts, loop
+     *        thread never holds it while calling a handler
+     */
+    mutex_t *lock;
+
+    /**
+     * @brief held by loop thread while calling a handler, delete from
+     *        another thread waits on it
+     */
+    mutex_t *dispatch_lock;
+
+    /**
+     * @brief callback_t posted, run in loop thread
+     */
+    linked_list_t *posts;
+
+    /**
+     * @brief eventfd waking up loop, -1 if none, and 1 while a wakeup is
+     *        pending, further wakeups coalesce into it
+     */
+    int wakefd;
+    int woken;
 };
-static private_event_t *local_free_pointer = NULL;
+
+/**
+ * @brief loop running in current thread, NULL if not a loop thread
+ */
+static THREAD_LOCAL private_event_t *current_loop = NULL;
 
 int find_evt_pkg_by_fd(void *item, void *key)
 {
@@ -145,25 +221,175 @@ static int find_evt_pkg_by_pkg(void *item, void *key)
     return 1;
 }
 
-static volatile int thread_onoff = 1;
+/**
+ * @brief wake up loop thread, no write while a wakeup is pending
+ */
+static void event_wakeup(private_event_t *this)
+{
+#ifndef _WIN32
+    uint64_t one = 1;
+
+    if (this->wakefd < 0 || ATOMIC_XCHG(&this->woken, 1)) return;
+    ignore_result(write(this->wakefd, &one, sizeof(one)));
+#endif
+}
+
+/**
+ * @brief run callbacks posted so far, in loop thread
+ */
+static void event_run_posts(private_event_t *this)
+{
+    callback_t *post = NULL;
+    int count = 0;
+#ifndef _WIN32
+    uint64_t value = 0;
+
+    /**
+     * clear before taking posts, a post after this wakes loop again
+     */
+    if (this->wakefd >= 0) {
+        ATOMIC_XCHG(&this->woken, 0);
+        ignore_result(read(this->wakefd, &value, sizeof(value)));
+    }
+#endif
+
+    this->lock->lock(this->lock);
+    count = this->posts->get_count(this->posts);
+    this->lock->unlock(this->lock);
+
+    while (count-- > 0) {
+        post = NULL;
+        this->lock->lock(this->lock);
+        this->posts->remove_first(this->posts, (void **)&post);
+        this->lock->unlock(this->lock);
+        if (!post) break;
+        post->handler(post->arg);
+        free(post);
+    }
+}
+
+/**
+ * @brief call handler of fd in loop thread, entered with lock held, which
+ *        is let go once dispatch_lock is taken, so delete from another
+ *        thread either finds the package or waits for the handler
+ */
+static void event_call(private_event_t *this, void (*handler) (SOCKET fd, void *arg), SOCKET fd, void *arg)
+{
+    this->dispatch_lock->lock(this->dispatch_lock);
+    this->lock->unlock(this->lock);
+    if (handler) handler(fd, arg);
+    this->dispatch_lock->unlock(this->dispatch_lock);
+}
+
+/**
+ * @brief set fd in fd sets by its types, read set for any but writable,
+ *        write set only while writable is pending
+ */
+static void select_arm(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t *pkg = NULL;
+    int readable = 0, writable = 0;
+
+    this->evts->reset_enumerator(this->evts);
+    while (this->evts->enumerate(this->evts, (void **)&pkg)) {
+        if (pkg->fd != fd) continue;
+        if (pkg->type == EVENT_ON_WRITABLE) {
+            writable = 1;
+        } else {
+            readable = 1;
+        }
+    }
+
+    if (readable) {
+        FD_SET(fd, &this->rfds);
+    } else {
+        FD_CLR(fd, &this->rfds);
+    }
+    if (writable) {
+        FD_SET(fd, &this->wfds);
+    } else {
+        FD_CLR(fd, &this->wfds);
+    }
+}
+
+/**
+ * @brief call writable handlers of fds in wfds, each disarmed before its
+ *        handler runs, so it may add itself again
+ */
+static void select_dispatch_writable(private_event_t *this, fd_set *wfds)
+{
+    event_pkg_t *evt_pkg = NULL;
+    event_pkg_t evt;
+
+    while (1) {
+        this->lock->lock(this->lock);
+        evt_pkg = NULL;
+        this->evts->reset_enumerator(this->evts);
+        while (this->evts->enumerate(this->evts, (void **)&evt_pkg)) {
+            if (evt_pkg->type == EVENT_ON_WRITABLE && FD_ISSET(evt_pkg->fd, wfds)) break;
+            evt_pkg = NULL;
+        }
+        if (!evt_pkg) {
+            this->lock->unlock(this->lock);
+            return;
+        }
+
+        evt = *evt_pkg;
+        FD_CLR(evt.fd, wfds);
+        this->evts->remove(this->evts, evt_pkg, NULL);
+        free(evt_pkg);
+        select_arm(this, evt.fd);
+        event_call(this, evt.event_handler, evt.fd, evt.arg);
+    }
+}
+
+/**
+ * @brief stop listening on fd, free all its packages
+ */
+static void select_remove_fd(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t *evt_pkg = NULL;
+
+    this->evts->reset_enumerator(this->evts);
+    while (this->evts->enumerate(this->evts, (void **)&evt_pkg)) {
+        if (evt_pkg->fd == fd) {
+            this->evts->remove(this->evts, evt_pkg, NULL);
+            free(evt_pkg);
+            this->evts->reset_enumerator(this->evts);
+        }
+        evt_pkg = NULL;
+    }
+    select_arm(this, fd);
+}
+
 void *select_events_handler(private_event_t *this)
 {
     int    ready_fds_cnt = 0;
     int    read_bytes    = 0;
+    int    max_fd        = 0;
+    int    retried       = 0;
     struct timeval tv    = {0};
     event_pkg_t *evt_pkg;
     event_pkg_t evt;
     SOCKET      evt_fd;
     fd_set      rfds, wfds;
 
-    while (thread_onoff) {
+    current_loop = this;
+    while (!ATOMIC_LOAD(&this->stop)) {
         /**
          * set event fds
          */
         FD_ZERO(&rfds);
         FD_ZERO(&wfds);
-        rfds = this->select_rfds;
-        wfds = this->select_wfds;
+        this->lock->lock(this->lock);
+        rfds   = this->select_rfds;
+        wfds   = this->select_wfds;
+        max_fd = this->max_fd;
+        this->lock->unlock(this->lock);
+#ifndef _WIN32
+        FD_SET(this->wakefd, &rfds);
+        if (this->wakefd > max_fd) max_fd = this->wakefd;
+#endif
 
         /**
          * wait time
@@ -174,18 +400,36 @@ void *select_events_handler(private_event_t *this)
         /**
          * wait socket event
          */
-        ready_fds_cnt = select(this->max_fd + 1, &rfds, &wfds, NULL, &tv);
+        ready_fds_cnt = select(max_fd + 1, &rfds, &wfds, NULL, &tv);
+
+        /**
+         * fd deleted and closed after sets were copied, copy them again
+         */
+        if (ready_fds_cnt < 0 && (errno == EINTR || (errno == EBADF && !retried))) {
+            retried = errno == EBADF;
+            continue;
+        }
+        retried = 0;
         switch (ready_fds_cnt) {
             case 0:
                 if (this->timeout_handler.handler != NULL) this->timeout_handler.handler(this->timeout_handler.arg);
                 break;
             case -1:
                 if (this->error_handler.handler != NULL) this->error_handler.handler(this->error_handler.arg);
-                thread_onoff = 0;
+                ATOMIC_STORE(&this->stop, 1);
                 break;
             default:
+#ifndef _WIN32
+                if (FD_ISSET(this->wakefd, &rfds)) {
+                    FD_CLR(this->wakefd, &rfds);
+                    ready_fds_cnt--;
+                    event_run_posts(this);
+                }
+#endif
+                select_dispatch_writable(this, &wfds);
                 while (ready_fds_cnt-- > 0) {
-                    
+                    this->lock->lock(this->lock);
+                    evt_pkg = NULL;
                     this->evts->reset_enumerator(this->evts);
                     while (this->evts->enumerate(this->evts, (void **)&evt_pkg)) {
                         if (FD_ISSET(evt_pkg->fd, &rfds)) {
@@ -195,10 +439,16 @@ void *select_events_handler(private_event_t *this)
                         
                     }
                     if (!evt_pkg) {
+                        this->lock->unlock(this->lock);
                         break;
                     }
                     evt_fd = evt_pkg->fd;
 
+                    /**
+                     * dispatch once per wakeup, drained fd reads 0 bytes
+                     * and would look closed
+                     */
+                    FD_CLR(evt_fd, &rfds);
                     IOCTL_READ_BYTES(evt_fd, read_bytes);
                     evt.fd  = evt_fd;
                     evt_pkg = NULL;
@@ -216,64 +466,346 @@ void *select_events_handler(private_event_t *this)
                         this->evts->find_first(this->evts, (void **)&evt_pkg, &evt, find_evt_pkg_by_pkg);
                     }
 
-                    if (evt_pkg && evt_pkg->event_handler) {
-                        evt_pkg->event_handler(evt_pkg->fd, evt_pkg->arg);
-
-                        /**
-                         * remove closed fd
-                         */
-                        if (evt_pkg->type == EVENT_ON_CLOSE) {
-                            FD_CLR(evt_pkg->fd, &this->rfds);
-                            FD_CLR(evt_pkg->fd, &this->wfds);
-                            this->evts->remove(this->evts, evt_pkg, NULL);
-
-                            this->evts->reset_enumerator(this->evts);
-                            while (this->evts->enumerate(this->evts, (void **)&evt_pkg)) {
-                                if (evt_pkg->fd == evt_fd) {
-                                    FD_CLR(evt_pkg->fd, &this->rfds);
-                                    FD_CLR(evt_pkg->fd, &this->wfds);
-                                    this->evts->remove(this->evts, evt_pkg, NULL);
-                                    this->evts->reset_enumerator(this->evts);
-                                }
-                                evt_pkg = NULL;
-                            }
-                        }
+                    if (!evt_pkg) {
+                        this->lock->unlock(this->lock);
+                        continue;
                     }
+
+                    /**
+                     * closed fd removed before its handler, which may
+                     * close it, so a new fd of same number added by
+                     * another thread meanwhile is kept
+                     */
+                    evt = *evt_pkg;
+                    if (evt.type == EVENT_ON_CLOSE) select_remove_fd(this, evt_fd);
+                    event_call(this, evt.event_handler, evt.fd, evt.arg);
                 }
 
                 break;
         }
+#ifdef _WIN32
+        event_run_posts(this);
+#endif
     }
 
+    /**
+     * posts made before destroy still run
+     */
+    event_run_posts(this);
+
     return NULL;
 }
 
-static void signal_handler(int sig)
+#ifndef _WIN32
+/**
+ * @brief package of fd for type, NULL if not listening on
+ */
+static event_pkg_t *epoll_pkg_find(private_event_t *this, SOCKET fd, event_type_t type)
 {
-    switch (sig) {
-        case SIGINT:
-        case SIGTERM:
-            local_free_pointer->public.destroy(&local_free_pointer->public);
-            exit(1);
-            break;
-        default:
-            break;
+    event_pkg_t *pkg = NULL;
+
+    if (fd >= this->fd_cap) return NULL;
+    for (pkg = this->fds[fd]; pkg; pkg = pkg->next) {
+        if (pkg->type == type) break;
     }
+
+    return pkg;
 }
 
-METHOD(event_t, add_, int, private_event_t *this, SOCKET fd, event_type_t type, void (*handler) (SOCKET fd, void *arg), void *arg)
+/**
+ * @brief stop listening on fd, free all its packages
+ */
+static void epoll_remove_fd(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t *pkg = NULL;
+
+    if (fd >= this->fd_cap || !this->fds[fd]) return;
+    epoll_ctl(this->epfd, EPOLL_CTL_DEL, fd, NULL);
+    while ((pkg = this->fds[fd]) != NULL) {
+        this->fds[fd] = pkg->next;
+        free(pkg);
+    }
+}
+
+/**
+ * @brief epoll events of fd by its types, EPOLLIN for any but writable,
+ *        EPOLLOUT only while writable pending, edge triggered if any type
+ *        of fd asked for it
+ */
+static unsigned int epoll_mask(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t *pkg = NULL;
+    unsigned int events = 0;
+
+    for (pkg = this->fds[fd]; pkg; pkg = pkg->next) {
+        if (pkg->type == EVENT_ON_WRITABLE) {
+            events |= EPOLLOUT;
+        } else {
+            events |= EPOLLIN;
+        }
+        if (pkg->edge) events |= EPOLLET | EPOLLRDHUP;
+    }
+
+    return events;
+}
+
+/**
+ * @brief register fd or change its registration to epoll_mask
+ *
+ * @param op  EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * @return    0 if succ, -1 if failed
+ */
+static int epoll_arm(private_event_t *this, SOCKET fd, int op)
+{
+    struct epoll_event ev = {0};
+
+    ev.events  = epoll_mask(this, fd);
+    ev.data.fd = fd;
+
+    return epoll_ctl(this->epfd, op, fd, &ev);
+}
+
+/**
+ * @brief call writable handler of fd, disarmed before it runs, so it may
+ *        add itself again
+ */
+static void epoll_dispatch_writable(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t **prev = NULL, *pkg = NULL;
+    void (*handler) (SOCKET fd, void *arg);
+    void *arg = NULL;
+
+    this->lock->lock(this->lock);
+    for (prev = &this->fds[fd]; (pkg = *prev) != NULL; prev = &pkg->next) {
+        if (pkg->type == EVENT_ON_WRITABLE) break;
+    }
+    if (!pkg) {
+        this->lock->unlock(this->lock);
+        return;
+    }
+
+    *prev   = pkg->next;
+    handler = pkg->event_handler;
+    arg     = pkg->arg;
+    free(pkg);
+    if (!this->fds[fd]) {
+        epoll_ctl(this->epfd, EPOLL_CTL_DEL, fd, NULL);
+    } else {
+        epoll_arm(this, fd, EPOLL_CTL_MOD);
+    }
+    event_call(this, handler, fd, arg);
+}
+
+/**
+ * @brief dispatch ready fd like select loop does, type by bytes readable
+ *
+ * @param events  epoll events of fd
+ */
+static void epoll_dispatch(private_event_t *this, SOCKET fd, unsigned int events)
+{
+    event_pkg_t pkg_copy, *pkg = NULL;
+    int read_bytes = 0;
+
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) epoll_dispatch_writable(this, fd);
+
+    /**
+     * writable only, nothing to read
+     */
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) return;
+
+    /**
+     * fd deleted by an earlier handler of same wakeup
+     */
+    this->lock->lock(this->lock);
+    if (fd >= this->fd_cap || !this->fds[fd]) {
+        this->lock->unlock(this->lock);
+        return;
+    }
+
+    IOCTL_READ_BYTES(fd, read_bytes);
+    if (!read_bytes) {
+        pkg = epoll_pkg_find(this, fd, EVENT_ON_ACCEPT);
+        if (!pkg) pkg = epoll_pkg_find(this, fd, EVENT_ON_CLOSE);
+    } else {
+        pkg = epoll_pkg_find(this, fd, EVENT_ON_RECV);
+    }
+    if (!pkg) {
+        this->lock->unlock(this->lock);
+        return;
+    }
+
+    /**
+     * handler may delete its own package, closed fd removed before its
+     * handler, which may close it, so a new fd of same number added by
+     * another thread meanwhile is kept
+     */
+    pkg_copy = *pkg;
+    if (pkg_copy.type == EVENT_ON_CLOSE) epoll_remove_fd(this, fd);
+    event_call(this, pkg_copy.event_handler, fd, pkg_copy.arg);
+    if (pkg_copy.type == EVENT_ON_CLOSE) return;
+
+    /**
+     * edge triggered peer closed behind data, no edge comes after the
+     * handler drained it, report close now
+     */
+    if (!pkg_copy.edge || pkg_copy.type != EVENT_ON_RECV || !(events & (EPOLLRDHUP | EPOLLHUP))) return;
+    this->lock->lock(this->lock);
+    IOCTL_READ_BYTES(fd, read_bytes);
+    pkg = read_bytes ? NULL : epoll_pkg_find(this, fd, EVENT_ON_CLOSE);
+    if (!pkg) {
+        this->lock->unlock(this->lock);
+        return;
+    }
+    pkg_copy = *pkg;
+    epoll_remove_fd(this, fd);
+    event_call(this, pkg_copy.event_handler, fd, pkg_copy.arg);
+}
+
+void *epoll_events_handler(private_event_t *this)
+{
+    struct epoll_event evts[DFT_EPOLL_EVENTS];
+    int ready_fds_cnt = 0, i = 0;
+
+    current_loop = this;
+    while (!ATOMIC_LOAD(&this->stop)) {
+        ready_fds_cnt = epoll_wait(this->epfd, evts, DFT_EPOLL_EVENTS, this->timeout);
+        if (ready_fds_cnt < 0 && errno == EINTR) continue;
+        switch (ready_fds_cnt) {
+            case 0:
+                if (this->timeout_handler.handler != NULL) this->timeout_handler.handler(this->timeout_handler.arg);
+                break;
+            case -1:
+                if (this->error_handler.handler != NULL) this->error_handler.handler(this->error_handler.arg);
+                ATOMIC_STORE(&this->stop, 1);
+                break;
+            default:
+                for (i = 0; i < ready_fds_cnt; i++) {
+                    if (evts[i].data.fd == this->wakefd) {
+                        event_run_posts(this);
+                    } else {
+                        epoll_dispatch(this, evts[i].data.fd, evts[i].events);
+                    }
+                }
+                break;
+        }
+    }
+
+    /**
+     * posts made before destroy still run
+     */
+    event_run_posts(this);
+
+    return NULL;
+}
+
+/**
+ * @brief fd table large enough for fd
+ *
+ * @return 0 if succ, -1 if failed
+ */
+static int epoll_grow(private_event_t *this, SOCKET fd)
+{
+    event_pkg_t **fds = NULL;
+    int cap = this->fd_cap > 0 ? this->fd_cap : DFT_EPOLL_FDS;
+
+    while (cap <= fd) cap *= 2;
+    fds = realloc(this->fds, cap * sizeof(event_pkg_t *));
+    if (!fds) return -1;
+    memset(fds + this->fd_cap, 0, (cap - this->fd_cap) * sizeof(event_pkg_t *));
+    this->fds    = fds;
+    this->fd_cap = cap;
+
+    return 0;
+}
+
+static int epoll_add(private_event_t *this, SOCKET fd, event_type_t type, void (*handler) (SOCKET fd, void *arg), void *arg)
+{
+    event_pkg_t *pkg = NULL, *head = NULL;
+    int edge = (type & EVENT_EDGE) != 0, op = 0;
+    unsigned int events = 0;
+
+    type &= ~EVENT_EDGE;
+    if (fd >= this->fd_cap && epoll_grow(this, fd) != 0) return -1;
+    events = epoll_mask(this, fd);
+    pkg = epoll_pkg_find(this, fd, type);
+    if (pkg) {
+        pkg->arg = arg;
+        pkg->event_handler = handler;
+        pkg->edge = edge;
+        if (epoll_mask(this, fd) == events) return 0;
+        return epoll_arm(this, fd, EPOLL_CTL_MOD);
+    }
+
+    pkg = (event_pkg_t *)malloc(sizeof(event_pkg_t));
+    if (!pkg) return -1;
+    pkg->fd   = fd;
+    pkg->type = type;
+    pkg->arg  = arg;
+    pkg->edge = edge;
+    pkg->event_handler = handler;
+
+    /**
+     * one epoll registration per fd, shared by its types, changed only
+     * when its events do
+     */
+    head = this->fds[fd];
+    op   = head ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    pkg->next = head;
+    this->fds[fd] = pkg;
+    if ((op == EPOLL_CTL_ADD || epoll_mask(this, fd) != events) && epoll_arm(this, fd, op) != 0) {
+        this->fds[fd] = head;
+        free(pkg);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int epoll_delete(private_event_t *this, SOCKET fd, event_type_t type)
+{
+    event_pkg_t **prev = NULL, *pkg = NULL;
+    unsigned int events = 0;
+
+    type &= ~EVENT_EDGE;
+    if (fd < 0 || fd >= this->fd_cap) return 0;
+    events = epoll_mask(this, fd);
+    for (prev = &this->fds[fd]; (pkg = *prev) != NULL; prev = &pkg->next) {
+        if (pkg->type == type) break;
+    }
+    if (!pkg) return 0;
+
+    *prev = pkg->next;
+    if (!this->fds[fd]) {
+        epoll_ctl(this->epfd, EPOLL_CTL_DEL, fd, NULL);
+    } else if (epoll_mask(this, fd) != events) {
+        epoll_arm(this, fd, EPOLL_CTL_MOD);
+    }
+    free(pkg);
+
+    return 0;
+}
+#endif
+
+static int select_add(private_event_t *this, SOCKET fd, event_type_t type, void (*handler) (SOCKET fd, void *arg), void *arg)
 {
     event_pkg_t *pkg = NULL;
     event_pkg_t evt  = {0};
     int new_flag     = 0;
 
-    if (!handler || fd < 1) return -1;
+#ifndef _WIN32
+    /**
+     * fd_set holds fds below FD_SETSIZE only
+     */
+    if (fd >= FD_SETSIZE) return -1;
+#endif
+    type &= ~EVENT_EDGE;
 
     evt.fd   = fd;
     evt.type = type;
     this->evts->find_first(this->evts, (void **)&pkg, &evt, find_evt_pkg_by_pkg);
     if (!pkg) {
         pkg = (event_pkg_t *)malloc(sizeof(event_pkg_t));
+        if (!pkg) return -1;
         new_flag = 1;
     }
 
@@ -287,8 +819,7 @@ METHOD(event_t, add_, int, private_event_t *this, SOCKET fd, event_type_t type,
 
     if (new_flag) {
         this->evts->insert_last(this->evts, pkg);
-        FD_SET(fd, &this->rfds);
-        FD_SET(fd, &this->wfds);
+        select_arm(this, fd);
 
         /**
          * set select max fd and fdsets
@@ -302,38 +833,127 @@ METHOD(event_t, add_, int, private_event_t *this, SOCKET fd, event_type_t type,
     return 0;
 }
 
-METHOD(event_t, delete_, int, private_event_t *this, SOCKET fd, event_type_t type)
+static int select_delete(private_event_t *this, SOCKET fd, event_type_t type)
 {
     event_pkg_t *pkg = NULL;
     event_pkg_t dpkg = {0};
 
+    type &= ~EVENT_EDGE;
     dpkg.fd   = fd;
     dpkg.type = type;
     this->evts->find_first(this->evts, (void **)&pkg, &dpkg, find_evt_pkg_by_pkg);
     if (pkg) {
-        FD_CLR(fd, &this->rfds);
-        FD_CLR(fd, &this->wfds);
         this->evts->remove(this->evts, pkg, NULL);
+        free(pkg);
+        select_arm(this, fd);
     }
     return 0;
 }
 
-METHOD(event_t, destroy_, void, private_event_t *this)
+METHOD(event_t, add_, int, private_event_t *this, SOCKET fd, event_type_t type, void (*handler) (SOCKET fd, void *arg), void *arg)
 {
-    if (this->thread != NULL) {
-        thread_onoff = 0;
+    int ret = 0;
+
+    if (!handler || fd < 1) return -1;
+    this->lock->lock(this->lock);
 #ifndef _WIN32
-        usleep(100);
-#else 
-        Sleep(100);
+    if (this->backend == EVENT_BACKEND_EPOLL) {
+        ret = epoll_add(this, fd, type, handler, arg);
+    } else
+#endif
+    ret = select_add(this, fd, type, handler, arg);
+    this->lock->unlock(this->lock);
+
+    /**
+     * select waits on a copy of fd sets, let it copy them again
+     */
+    if (ret == 0 && this->backend == EVENT_BACKEND_SELECT && current_loop != this) event_wakeup(this);
+
+    return ret;
+}
+
+METHOD(event_t, delete_, int, private_event_t *this, SOCKET fd, event_type_t type)
+{
+    int ret = 0, one = 0;
+
+    /**
+     * packages are kept per type, delete or-ed types one by one
+     */
+    this->lock->lock(this->lock);
+    for (one = EVENT_ON_ACCEPT; one <= EVENT_ON_WRITABLE; one <<= 1) {
+        if (!(type & one)) continue;
+#ifndef _WIN32
+        if (this->backend == EVENT_BACKEND_EPOLL) {
+            ret = epoll_delete(this, fd, (event_type_t)one);
+        } else
 #endif
-        this->thread->cancel(this->thread);
+        ret = select_delete(this, fd, (event_type_t)one);
+    }
+    this->lock->unlock(this->lock);
+
+    /**
+     * from another thread, wait for a handler running meanwhile, its arg
+     * can be freed once delete returned
+     */
+    if (current_loop != this) {
+        if (this->backend == EVENT_BACKEND_SELECT) event_wakeup(this);
+        this->dispatch_lock->lock(this->dispatch_lock);
+        this->dispatch_lock->unlock(this->dispatch_lock);
+    }
+
+    return ret;
+}
+
+METHOD(event_t, post_, int, private_event_t *this, void (*handler) (void *arg), void *arg)
+{
+    callback_t *post = NULL;
+
+    if (!handler) return -1;
+    post = (callback_t *)malloc(sizeof(callback_t));
+    if (!post) return -1;
+    post->handler = handler;
+    post->arg     = arg;
+
+    this->lock->lock(this->lock);
+    this->posts->insert_last(this->posts, post);
+    this->lock->unlock(this->lock);
+    event_wakeup(this);
+
+    return 0;
+}
+
+METHOD(event_t, destroy_, void, private_event_t *this)
+{
+    int i = 0;
+
+    /**
+     * wake up loop to see stop, no wakeup on windows, select returns
+     * within timeout
+     */
+    if (this->thread != NULL) {
+        ATOMIC_STORE(&this->stop, 1);
+        event_wakeup(this);
+        this->thread->join(this->thread);
     }
     if (this->evts) {
         this->evts->clear(this->evts);
         this->evts->destroy(this->evts);
     }
-   
+    if (this->posts) {
+        this->posts->clear(this->posts);
+        this->posts->destroy(this->posts);
+    }
+#ifndef _WIN32
+    if (this->fds) {
+        for (i = 0; i < this->fd_cap; i++) epoll_remove_fd(this, i);
+        free(this->fds);
+    }
+    if (this->epfd >= 0) close(this->epfd);
+    if (this->wakefd >= 0) close(this->wakefd);
+#endif
+    DESTROY_IF(this->lock);
+    DESTROY_IF(this->dispatch_lock);
+
     free(this);
 }
 
@@ -356,27 +976,28 @@ METHOD(event_t, exception_handle_, void, private_event_t *this, exception_type_t
 static int start_event_capture(private_event_t *this)
 {
     void *handler = NULL;
-    
-    /**
-     * act signal
-     */
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
 
     /**
      * act socket event
      */
     handler = (void *)select_events_handler;
+#ifndef _WIN32
+    if (this->backend == EVENT_BACKEND_EPOLL) handler = (void *)epoll_events_handler;
+#endif
     this->thread = thread_create(handler, this);
     if (!this->thread) return -1;
 
     return 0;
 }
 
-event_t *event_create(int timeout)
+event_t *event_create_ext(int timeout, event_backend_t backend)
 {
     private_event_t *this;
 
+#ifdef _WIN32
+    if (backend == EVENT_BACKEND_EPOLL) return NULL;
+#endif
+
 #ifndef _WIN32
     INIT(this,
         .public = {
@@ -384,12 +1005,58 @@ event_t *event_create(int timeout)
             .delete  = _delete_,
             .destroy = _destroy_,
             .exception_handle = _exception_handle_,
+            .post    = _post_,
         },
         .thread     = NULL,
         .flag       = 0,
         .timeout    = timeout < 0 ? 0 : timeout,
         .evts       = linked_list_create(),
+        .backend    = EVENT_BACKEND_SELECT,
+        .epfd       = -1,
+        .fds        = NULL,
+        .fd_cap     = 0,
+        .stop       = 0,
+        .lock       = mutex_create(),
+        .dispatch_lock = mutex_create(),
+        .posts      = linked_list_create(),
+        .wakefd     = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC),
+        .woken      = 0,
     );
+    if (!this->lock || !this->dispatch_lock || !this->evts || !this->posts || this->wakefd < 0) {
+        _destroy_(this);
+        return NULL;
+    }
+
+    /**
+     * epoll unless select asked for, select if epoll not available
+     */
+    if (backend != EVENT_BACKEND_SELECT) {
+        this->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (this->epfd >= 0) {
+            this->backend = EVENT_BACKEND_EPOLL;
+        } else if (backend == EVENT_BACKEND_EPOLL) {
+            _destroy_(this);
+            return NULL;
+        }
+    }
+
+    /**
+     * wakeup fd is waited on with the others, select holds it only below
+     * FD_SETSIZE
+     */
+    if (this->backend == EVENT_BACKEND_EPOLL) {
+        struct epoll_event ev = {0};
+
+        ev.events  = EPOLLIN;
+        ev.data.fd = this->wakefd;
+        if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, this->wakefd, &ev) != 0) {
+            _destroy_(this);
+            return NULL;
+        }
+    } else if (this->wakefd >= FD_SETSIZE) {
+        _destroy_(this);
+        return NULL;
+    }
 #else 
     INIT(this, private_event_t, 
         {
@@ -397,6 +1064,7 @@ event_t *event_create(int timeout)
             delete_,
             destroy_,
             exception_handle_,
+            post_,
         },
         NULL,
         0,
@@ -408,9 +1076,22 @@ event_t *event_create(int timeout)
         NULL,
         NULL,
         0,
+        EVENT_BACKEND_SELECT,
+        -1,
+        NULL,
+        0,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        -1,
+        0,
     );
 
-    this->evts = linked_list_create();
+    this->evts          = linked_list_create();
+    this->lock          = mutex_create();
+    this->dispatch_lock = mutex_create();
+    this->posts         = linked_list_create();
 #endif
 
     if (start_event_capture(this) < 0) {
@@ -422,6 +1103,307 @@ event_t *event_create(int timeout)
         return NULL;
     }
 
-    local_free_pointer = this;
     return &this->public;
 }
+
+event_t *event_create(int timeout)
+{
+    return event_create_ext(timeout, EVENT_BACKEND_AUTO);
+}
+
+typedef struct event_listener_t event_listener_t;
+struct event_listener_t {
+    /**
+     * @brief loop accepting on listener
+     */
+    event_t *loop;
+
+    /**
+     * @brief listening socket of loop
+     */
+    tcp_t *tcp;
+    SOCKET fd;
+
+    /**
+     * @brief connection handler and its parameter
+     */
+    void (*handler) (event_t *loop, SOCKET fd, void *arg);
+    void *arg;
+
+    /**
+     * @brief fd kept open to be given up when process runs out of
+     *        fds, -1 if none
+     */
+    int spare;
+};
+
+typedef struct private_event_group_t private_event_group_t;
+struct private_event_group_t {
+    /**
+     * @brief public interface
+     */
+    event_group_t public;
+
+    /**
+     * @brief event loops
+     */
+    event_t **loops;
+    int count;
+
+    /**
+     * @brief round robin cursor of next
+     */
+    unsigned int cursor;
+
+    /**
+     * @brief event_listener_t of listen
+     */
+    linked_list_t *listeners;
+};
+
+/**
+ * @brief cpus process may run on
+ *
+ * @return count of cpus in *cpus, -1 if failed
+ */
+static int allowed_cpus(int **cpus)
+{
+#ifndef _WIN32
+    cpu_set_t set;
+#else
+    DWORD_PTR mask = 0, sys_mask = 0;
+#endif
+    int i = 0, cnt = 0;
+
+#ifndef _WIN32
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    *cpus = malloc(CPU_COUNT(&set) * sizeof(int));
+    if (!*cpus) return -1;
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) (*cpus)[cnt++] = i;
+    }
+#else
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &sys_mask)) return -1;
+    *cpus = malloc(sizeof(mask) * 8 * sizeof(int));
+    if (!*cpus) return -1;
+    for (i = 0; i < (int)sizeof(mask) * 8; i++) {
+        if (mask & ((DWORD_PTR)1 << i)) (*cpus)[cnt++] = i;
+    }
+#endif
+
+    return cnt;
+}
+
+/**
+ * @brief accept handler of listener, runs in its loop, takes every
+ *        pending connection
+ */
+static void group_accept(SOCKET fd, void *arg)
+{
+    event_listener_t *listener = arg;
+    int conn = 0;
+
+    while (1) {
+        conn = accept(fd, NULL, NULL);
+        if (conn >= 0) {
+            listener->handler(listener->loop, conn, listener->arg);
+            continue;
+        }
+#ifndef _WIN32
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+
+        /**
+         * out of fds, listener is edge triggered and is not reported
+         * again for connections left pending, give spare fd up to take
+         * and close them one by one
+         */
+        if ((errno == EMFILE || errno == ENFILE) && listener->spare >= 0) {
+            close(listener->spare);
+            conn = accept(fd, NULL, NULL);
+            if (conn >= 0) close(conn);
+            listener->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (conn >= 0) continue;
+        }
+#endif
+        break;
+    }
+}
+
+static void listener_destroy(event_listener_t *this)
+{
+    this->loop->delete(this->loop, this->fd, EVENT_ON_ACCEPT);
+    this->tcp->destroy(this->tcp);
+#ifndef _WIN32
+    if (this->spare >= 0) close(this->spare);
+#endif
+    free(this);
+}
+
+METHOD(event_group_t, next_, event_t *, private_event_group_t *this)
+{
+    return this->loops[(ATOMIC_ADD(&this->cursor, 1) - 1) % this->count];
+}
+
+METHOD(event_group_t, get_, event_t *, private_event_group_t *this, int index)
+{
+    if (index < 0 || index >= this->count) return NULL;
+    return this->loops[index];
+}
+
+METHOD(event_group_t, size_, int, private_event_group_t *this)
+{
+    return this->count;
+}
+
+METHOD(event_group_t, listen_, int, private_event_group_t *this, int family, char *ip, int port,
+       void (*handler) (event_t *loop, SOCKET fd, void *arg), void *arg)
+{
+    event_listener_t *listener = NULL;
+#ifdef _WIN32
+    u_long on = 1;
+#endif
+    int i = 0;
+
+    if (!handler) return -1;
+
+    /**
+     * one listener per loop on the same port, kernel spreads connections
+     */
+    for (i = 0; i < this->count; i++) {
+        listener = calloc(1, sizeof(event_listener_t));
+        if (!listener) goto failed;
+        listener->loop    = this->loops[i];
+        listener->handler = handler;
+        listener->arg     = arg;
+        listener->spare   = -1;
+        listener->tcp     = tcp_create(family);
+        if (!listener->tcp) {
+            free(listener);
+            goto failed;
+        }
+        listener->fd = listener->tcp->listen_reuseport(listener->tcp, family, ip, port);
+        if (listener->fd < 0) {
+            listener->tcp->destroy(listener->tcp);
+            free(listener);
+            goto failed;
+        }
+#ifndef _WIN32
+        fcntl(listener->fd, F_SETFL, fcntl(listener->fd, F_GETFL, 0) | O_NONBLOCK);
+
+        /**
+         * loop may accept as soon as listener is added
+         */
+        listener->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#else
+        ioctlsocket(listener->fd, FIONBIO, &on);
+#endif
+        if (listener->loop->add(listener->loop, listener->fd, EVENT_ON_ACCEPT | EVENT_EDGE, group_accept, listener) != 0) {
+            listener->tcp->destroy(listener->tcp);
+#ifndef _WIN32
+            if (listener->spare >= 0) close(listener->spare);
+#endif
+            free(listener);
+            goto failed;
+        }
+        this->listeners->insert_last(this->listeners, listener);
+    }
+
+    return 0;
+
+failed:
+    /**
+     * listeners of this call are the last ones, none of them stays
+     */
+    while (i-- > 0) {
+        this->listeners->remove_last(this->listeners, (void **)&listener);
+        listener_destroy(listener);
+    }
+    return -1;
+}
+
+METHOD(event_group_t, group_destroy_, void, private_event_group_t *this)
+{
+    event_listener_t *listener = NULL;
+    int i = 0;
+
+    if (this->listeners) {
+        while (this->listeners->remove_first(this->listeners, (void **)&listener) != NOT_FOUND) {
+            listener_destroy(listener);
+        }
+        this->listeners->destroy(this->listeners);
+    }
+    if (this->loops) {
+        for (i = 0; i < this->count; i++) {
+            if (this->loops[i]) this->loops[i]->destroy(this->loops[i]);
+        }
+        free(this->loops);
+    }
+    free(this);
+}
+
+event_group_t *event_group_create(int loops, int timeout)
+{
+    private_event_group_t *this;
+    thread_t *thread = NULL;
+    int *cpus = NULL;
+    int i = 0, cpu_count = allowed_cpus(&cpus);
+
+    if (loops <= 0) loops = cpu_count > 0 ? cpu_count : 1;
+
+#ifndef _WIN32
+    INIT(this,
+        .public = {
+            .next    = _next_,
+            .get     = _get_,
+            .size    = _size_,
+            .listen  = _listen_,
+            .destroy = _group_destroy_,
+        },
+        .loops     = calloc(loops, sizeof(event_t *)),
+        .count     = loops,
+        .cursor    = 0,
+        .listeners = linked_list_create(),
+    );
+#else
+    INIT(this, private_event_group_t,
+        {
+            next_,
+            get_,
+            size_,
+            listen_,
+            group_destroy_,
+        },
+        calloc(loops, sizeof(event_t *)),
+        loops,
+        0,
+        linked_list_create(),
+    );
+#endif
+    if (!this->loops || !this->listeners) goto failed;
+
+    /**
+     * loop i runs on i-th cpu process may run on, wraps around if more
+     * loops than cpus, a loop that can not be pinned keeps all of them
+     */
+    for (i = 0; i < loops; i++) {
+        this->loops[i] = event_create(timeout);
+        if (!this->loops[i]) goto failed;
+        if (cpu_count <= 0) continue;
+        thread = ((private_event_t *)this->loops[i])->thread;
+        if (thread->set_affinity(thread, &cpus[i % cpu_count], 1) != 0) {
+            thread->set_affinity(thread, cpus, cpu_count);
+        }
+    }
+    free(cpus);
+
+    return &this->public;
+
+failed:
+    free(cpus);
+#ifndef _WIN32
+    _group_destroy_(this);
+#else
+    group_destroy_(this);
+#endif
+    return NULL;
+}
@@ -14,7 +14,28 @@ enum event_type_t
     EVENT_ON_CONNECT = 1     << 2,
     EVENT_ON_RECV    = 1     << 3,
     EVENT_ON_CLOSE   = 1     << 4,
-    EVENT_ON_ALL     = 0x111 << 1
+
+    /**
+     * send buffer has room again, one shot: removed before its handler
+     * is called, handler adds it again while output is still pending,
+     * add it only after send returned EAGAIN, an fd with room is ready at
+     * once
+     */
+    EVENT_ON_WRITABLE = 1    << 5,
+
+    /**
+     * every type, to delete all listening of an fd
+     */
+    EVENT_ON_ALL     = EVENT_ON_ACCEPT | EVENT_ON_CONNECT | EVENT_ON_RECV |
+                       EVENT_ON_CLOSE | EVENT_ON_WRITABLE,
+
+    /**
+     * flag or-ed to type on add, epoll only: fd is reported once per
+     * state change, handler must read or accept until EAGAIN on a non
+     * blocking fd, or is not called again until new data arrives, close
+     * is reported after the last data is read
+     */
+    EVENT_EDGE       = 1     << 16,
 };
 
 typedef enum exception_type_t exception_type_t;
@@ -23,28 +44,52 @@ enum exception_type_t {
     EXCEPTION_ERROR
 };
 
+typedef enum event_backend_t event_backend_t;
+enum event_backend_t {
+    /**
+     * epoll where available, select otherwise
+     */
+    EVENT_BACKEND_AUTO   = 0,
+
+    /**
+     * select, fds below FD_SETSIZE only, every ready fd scans all
+     * registrations
+     */
+    EVENT_BACKEND_SELECT = 1,
+
+    /**
+     * epoll, no fd limit, ready fd finds its registrations at once
+     */
+    EVENT_BACKEND_EPOLL  = 2,
+};
+
 typedef struct event_t event_t;
 struct event_t {
     /**
-     * @brief add socket event
+     * @brief add socket event, from any thread, takes effect at once
      *
      * @param fd        fd listening on
-     * @param type      type of listening
+     * @param type      type of listening, with EVENT_EDGE for edge
+     *                  triggered, every type of fd becomes edge triggered
      * @param handler   event handler callback
      * @param arg       parameter of callback
      */
     int (*add) (event_t *this, SOCKET fd, event_type_t type, void (*handler) (SOCKET fd, void *arg), void *arg);
 
     /**
-     * @brief delete socket event
+     * @brief delete socket event, from another thread waits for a handler
+     *        of loop running meanwhile, so its arg can be freed after,
+     *        must not be called holding what such a handler waits for
      *
      * @param fd        fd listening on
-     * @param type      type of listening
+     * @param type      type of listening, types can be or-ed, like
+     *                  EVENT_ON_ALL
      */
     int (*delete) (event_t *this, SOCKET fd, event_type_t type);
 
     /**
-     * @brief destroy instance and free memory
+     * @brief destroy instance and free memory, waits for loop thread to
+     *        finish, not from a handler of the loop
      */
     void (*destroy) (event_t *this);
 
@@ -52,11 +97,85 @@ struct event_t {
      * @brief exception handle
      */
     void (*exception_handle) (event_t *this, exception_type_t type, void (*handler) (void *), void *arg);
+
+    /**
+     * @brief run handler in loop thread, from any thread, loop is woken
+     *        up at once, posts before its next wakeup share it, run in
+     *        order, posts before destroy still run
+     *
+     * @param handler   callback
+     * @param arg       parameter of callback
+     * @return          0 if succ, -1 if failed
+     */
+    int (*post) (event_t *this, void (*handler) (void *arg), void *arg);
 };
 
 /**
- * @brief create socket event instance 
+ * @brief create socket event instance, EVENT_BACKEND_AUTO
+ * @param timeout   wait timeout in ms, EXCEPTION_TIMEOUT handler is called
+ *                  when nothing happened for this long
  */
 event_t *event_create(int timeout);
 
+/**
+ * @brief create socket event instance on backend
+ * @param timeout   wait timeout in ms
+ * @param backend   event_backend_t
+ * @return          instance, NULL if backend not available
+ */
+event_t *event_create_ext(int timeout, event_backend_t backend);
+
+typedef struct event_group_t event_group_t;
+
+/**
+ * Group of event loops, one thread each, pinned to one cpu each, to
+ * spread connections over cores.
+ */
+struct event_group_t {
+    /**
+     * @brief loop for a new connection, round robin
+     */
+    event_t *(*next) (event_group_t *this);
+
+    /**
+     * @brief loop of index
+     * @return          loop, NULL if index out of range
+     */
+    event_t *(*get) (event_group_t *this, int index);
+
+    /**
+     * @brief count of loops
+     */
+    int (*size) (event_group_t *this);
+
+    /**
+     * @brief listen on port with one SO_REUSEPORT listener per loop, the
+     *        kernel spreads connections over them, each is accepted and
+     *        handled in the thread of its loop
+     *
+     * @param ip        ip address listening on, can be NULL
+     * @param port      port listening on
+     * @param handler   called in loop thread with accepted fd, add it to
+     *                  that loop to keep connection on one core
+     * @param arg       parameter of handler
+     * @return          0 if succ, -1 if failed, listeners started before
+     *                  failing stay until destroy
+     */
+    int (*listen) (event_group_t *this, int family, char *ip, int port,
+                   void (*handler) (event_t *loop, SOCKET fd, void *arg), void *arg);
+
+    /**
+     * @brief close listeners, destroy loops and free memory
+     */
+    void (*destroy) (event_group_t *this);
+};
+
+/**
+ * @brief create group of event loops, EVENT_BACKEND_AUTO
+ * @param loops     count of loops, one per online cpu if 0
+ * @param timeout   wait timeout in ms of every loop
+ * @return          group, NULL if failed
+ */
+event_group_t *event_group_create(int loops, int timeout);
+
 #endif /* __SOCKET_EVENT__ */
@@ -61,6 +61,21 @@ static void make_reusable(int fd)
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(on));
 }
 
+/**
+ * @brief let several sockets bind one port, kernel spreads connections
+ *
+ * @return 0 if succ, -1 if not supported
+ */
+static int make_reuseport(int fd)
+{
+#ifdef SO_REUSEPORT
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(on));
+#else
+    return -1;
+#endif
+}
+
 #ifndef _WIN32
 static void make_nonblock(int fd)
 {
@@ -102,7 +117,10 @@ int win_sock_init()
 }
 #endif
 
-METHOD(tcp_t, listen_, int, private_tcp_t *this, int family, char *ip, int port)
+/**
+ * @brief server listen, shared port if reuseport
+ */
+static int tcp_listen(private_tcp_t *this, int family, char *ip, int port, int reuseport)
 {
     int ret = 0;
 
@@ -136,6 +154,10 @@ METHOD(tcp_t, listen_, int, private_tcp_t *this, int family, char *ip, int port)
      * socket bind
      */
     make_reusable(tcp_fd);
+    if (reuseport && make_reuseport(tcp_fd) != 0) {
+        perror("setsockopt()");
+        return -1;
+    }
     ret = bind(tcp_fd, tcp_host->get_sockaddr(tcp_host), sizeof(struct sockaddr));
     if (ret < 0) {
         perror("bind()");
@@ -145,7 +167,7 @@ METHOD(tcp_t, listen_, int, private_tcp_t *this, int family, char *ip, int port)
     /**
      * socket listen 
      */
-    ret = listen(tcp_fd, 5);
+    ret = listen(tcp_fd, SOMAXCONN);
     if (ret < 0) {
         perror("listen()");
         return -1;
@@ -155,6 +177,16 @@ METHOD(tcp_t, listen_, int, private_tcp_t *this, int family, char *ip, int port)
     return tcp_fd;
 }
 
+METHOD(tcp_t, listen_, int, private_tcp_t *this, int family, char *ip, int port)
+{
+    return tcp_listen(this, family, ip, port, 0);
+}
+
+METHOD(tcp_t, listen_reuseport_, int, private_tcp_t *this, int family, char *ip, int port)
+{
+    return tcp_listen(this, family, ip, port, 1);
+}
+
 METHOD(tcp_t, connect_, int, private_tcp_t *this, int family, char *ip, int port)
 {
     int ret = 0;
@@ -376,6 +408,7 @@ tcp_t *tcp_create(int family)
     INIT(this, 
         .public = {
             .listen     = _listen_,
+            .listen_reuseport = _listen_reuseport_,
             .connect    = _connect_,
             .connect_tm = _connect_tm_,
             .accept     = _accept_,
@@ -395,6 +428,7 @@ tcp_t *tcp_create(int family)
     INIT(this, private_tcp_t, 
         {
            listen_, 
+           listen_reuseport_,
            connect_,
 		   connect_tm_,
            accept_,
@@ -20,6 +20,16 @@ struct tcp_t {
      */
     int (*listen) (tcp_t *this, int family, char *ip, int port);
 
+    /**
+     * @brief server listen with SO_REUSEPORT, listeners of several tcp_t
+     *        on one port share its connections, one per event loop
+     *
+     * @param ip   [in] ip address listening on, can be NULL;
+     * @param port [in] port listening on, must be more than 0;
+     * @return     socket fd, if succ; -1, if failed or not supported;
+     */
+    int (*listen_reuseport) (tcp_t *this, int family, char *ip, int port);
+
     /**
      * @brief connect to server 
      *
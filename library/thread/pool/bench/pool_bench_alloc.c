@@ -0,0 +1,80 @@
+/**
+ * cost of task records on submit path, malloc/free against task record
+ * cache, producer allocates a batch of records and a worker thread frees
+ * them, like deque tasks taken by thieves and strand jobs
+ *
+ * usage: pool_bench_alloc [rounds]
+ */
+#include "../pool.c"
+#include <semaphore.h>
+
+#define BATCH 1024
+
+static void *batch[BATCH];
+static sem_t full, empty;
+static int use_cache;
+static int rounds;
+static long long free_ns;
+
+static void *consumer(void *arg)
+{
+    long long start = 0;
+    int r = 0, i = 0;
+
+    for (r = 0; r < rounds; r++) {
+        sem_wait(&full);
+        start = monotonic_ns();
+        for (i = 0; i < BATCH; i++) {
+            if (use_cache) task_rec_free(batch[i]);
+            else free(batch[i]);
+        }
+        free_ns += monotonic_ns() - start;
+        sem_post(&empty);
+    }
+    if (use_cache) task_cache_flush();
+
+    return NULL;
+}
+
+static void run(int cache)
+{
+    thread_task_t *task = NULL;
+    long long start = 0, alloc_ns = 0;
+    pthread_t worker;
+    int r = 0, i = 0;
+
+    use_cache = cache;
+    free_ns   = 0;
+    sem_init(&full, 0, 0);
+    sem_init(&empty, 0, 1);
+    pthread_create(&worker, NULL, consumer, NULL);
+
+    for (r = 0; r < rounds; r++) {
+        sem_wait(&empty);
+        start = monotonic_ns();
+        for (i = 0; i < BATCH; i++) {
+            task = cache ? task_rec_alloc() : malloc(sizeof(thread_task_t));
+            task->arg = batch;
+            batch[i]  = task;
+        }
+        alloc_ns += monotonic_ns() - start;
+        sem_post(&full);
+    }
+    pthread_join(worker, NULL);
+
+    printf("%s: producer alloc %.1f ns/rec, worker free %.1f ns/rec\n", cache ? "cache " : "malloc",
+           alloc_ns / (double)((long long)BATCH * rounds), free_ns / (double)((long long)BATCH * rounds));
+}
+
+int main(int argc, char *argv[])
+{
+    int i = 0;
+
+    rounds = argc > 1 ? atoi(argv[1]) : 4000;
+    for (i = 0; i < 3; i++) {
+        run(0);
+        run(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * jobs per second of empty jobs added from one thread
+ *
+ * usage: pool_bench_jobs [jobs] [threads]
+ *
+ * build it against an older libpool.so to compare before and after
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include "pool.h"
+
+static long done;
+
+static void job(void *arg)
+{
+    __atomic_add_fetch(&done, 1, __ATOMIC_RELAXED);
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int jobs    = argc > 1 ? atoi(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    pool_t *pool = NULL;
+    double start = 0, used = 0;
+    int i = 0;
+
+    pool = pool_create(threads, threads);
+    if (!pool) return 1;
+
+    start = now();
+    for (i = 0; i < jobs; i++) {
+        while (pool->addjob(pool, job, NULL) != 0) sched_yield();
+    }
+    while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < jobs) usleep(100);
+    used = now() - start;
+
+    printf("%d jobs, %d threads: %.0f jobs/s\n", jobs, threads, jobs / used);
+    pool->destroy(pool);
+
+    return 0;
+}
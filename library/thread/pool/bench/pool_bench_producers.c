@@ -0,0 +1,71 @@
+/**
+ * jobs per second of empty jobs added by 1 to 64 producer threads at
+ * once, producers retry while the queue is full
+ *
+ * usage: pool_bench_producers [jobs] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include "pool.h"
+
+#define MAX_PRODUCERS 64
+
+static pool_t *pool;
+static long done;
+static long per_producer;
+
+static void job(void *arg)
+{
+    __atomic_add_fetch(&done, 1, __ATOMIC_RELAXED);
+}
+
+static void *producer(void *arg)
+{
+    long i = 0;
+
+    for (i = 0; i < per_producer; i++) {
+        while (pool->addjob(pool, job, NULL) != 0) sched_yield();
+    }
+
+    return NULL;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    long jobs   = argc > 1 ? atol(argv[1]) : 400000;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    pthread_t producers[MAX_PRODUCERS];
+    double start = 0, used = 0;
+    int cnt = 0, i = 0;
+
+    pool = pool_create(threads, threads);
+    if (!pool) return 1;
+
+    for (cnt = 1; cnt <= MAX_PRODUCERS; cnt *= 2) {
+        per_producer = jobs / cnt;
+        __atomic_store_n(&done, 0, __ATOMIC_RELEASE);
+
+        start = now();
+        for (i = 0; i < cnt; i++) pthread_create(&producers[i], NULL, producer, NULL);
+        for (i = 0; i < cnt; i++) pthread_join(producers[i], NULL);
+        while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < per_producer * cnt) usleep(100);
+        used = now() - start;
+
+        printf("%2d producers, %d threads: %.0f jobs/s\n", cnt, threads, per_producer * cnt / used);
+    }
+    pool->destroy(pool);
+
+    return 0;
+}
@@ -1,730 +1,3869 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
 #include "pool.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <sched.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <thread/thread.h>
-#include <bsem/bsem.h>
 #include <mutex/mutex.h>
 #include <utils/utils.h>
-#include <linked_list/linked_list.h>
-#else 
+#else
 #pragma comment(lib, "Ws2_32.lib")
 #include <WinSock2.h>>
 #include <windows.h>
 #include "thread.h"
-#include "bsem.h"
 #include "mutex.h"
 #include "utils.h"
-#include "linked_list.h"
 #endif
 
-typedef struct private_pool_t private_pool_t;
-struct private_pool_t {
+/**
+ * @brief sleep while *addr equals val
+ */
+static void futex_wait(int *addr, int val)
+{
+#ifndef _WIN32
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+    WaitOnAddress(addr, &val, sizeof(int), INFINITE);
+#endif
+}
+
+/**
+ * @brief sleep while *addr equals val, at most timeout ms
+ *
+ * @return 0 if woken up, -1 if timed out
+ */
+static int futex_timed_wait(int *addr, int val, unsigned int timeout)
+{
+#ifndef _WIN32
+    struct timespec ts = {0};
+
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0) == -1 &&
+        errno == ETIMEDOUT) {
+        return -1;
+    }
+    return 0;
+#else
+    return WaitOnAddress(addr, &val, sizeof(int), timeout) ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief monotonic clock in ns
+ */
+static long long monotonic_ns()
+{
+#ifndef _WIN32
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (long long)GetTickCount64() * 1000000;
+#endif
+}
+#define monotonic_ms() (monotonic_ns() / 1000000)
+
+/**
+ * @brief wake up at most cnt threads sleeping on addr
+ */
+static void futex_wake(int *addr, int cnt)
+{
+#ifndef _WIN32
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, cnt, NULL, NULL, 0);
+#else
+    if (cnt == 1) WakeByAddressSingle(addr);
+    else WakeByAddressAll(addr);
+#endif
+}
+
+typedef struct thread_task_t thread_task_t;
+struct thread_task_t {
+    void (*work) (void *);
+    void *arg;
+
     /**
-     * @brief public interface
+     * @brief time added to pool, monotonic ns
      */
-    pool_t public;
+    long long stamp;
+};
 
+/**
+ * Slot of task ring, task is stored inline.
+ */
+typedef struct task_cell_t task_cell_t;
+struct task_cell_t {
     /**
-     * @brief pool whether created succ
+     * @brief sequence telling whether slot is ready to write or read
      */
-    int created;
+    unsigned long seq;
 
     /**
-     * @brief enable or disable thread manager
+     * @brief task in slot
      */
-    int enable_thread_manager;
+    thread_task_t task;
+};
+
+/**
+ * Bounded lock-free MPMC task ring (Vyukov), producer and consumer
+ * positions are on separate cache lines.
+ */
+typedef struct task_ring_t task_ring_t;
+struct task_ring_t {
+    char head_pad[CACHE_LINE_SIZE];
 
     /**
-     * @brief control task manager thread stop
+     * @brief next position to push
      */
-    int task_manager_stop;
+    unsigned long enqueue_pos;
+    char enqueue_pad[CACHE_LINE_SIZE - sizeof(unsigned long)];
 
     /**
-     * @brief control thread manager thread stop
+     * @brief next position to pop
      */
-    int thread_manager_stop;
+    unsigned long dequeue_pos;
+    char dequeue_pad[CACHE_LINE_SIZE - sizeof(unsigned long)];
 
     /**
-     * @brief thread pool size
+     * @brief capacity - 1
      */
-    int min_size;
+    unsigned long mask;
 
     /**
-     * @brief thread pool size
+     * @brief slots
      */
-    int cur_size;
+    task_cell_t *cells;
+    char tail_pad[CACHE_LINE_SIZE];
+};
 
+/**
+ * Entry of priority task heap, task is stored inline.
+ */
+typedef struct prio_entry_t prio_entry_t;
+struct prio_entry_t {
     /**
-     * @brief thread pool size
+     * @brief virtual deadline, monotonic ns, earliest runs first
      */
-    int max_size;
+    long long key;
 
     /**
-     * @brief list of busy thread
+     * @brief order of adding, keeps FIFO among equal keys
      */
-    linked_list_t *busy_thread_list;
-    
+    unsigned long seq;
+
     /**
-     * @brief list of idle thread
+     * @brief task
      */
-    linked_list_t *idle_thread_list;
+    thread_task_t task;
+};
 
+/**
+ * Counters of one worker slot, written only by the worker in the slot,
+ * summed by get_stats.
+ */
+typedef struct worker_stats_t worker_stats_t;
+struct worker_stats_t {
     /**
-     * @brief task in this pool
+     * @brief tasks run
      */
-    linked_list_t *task_list;
+    unsigned long long completed;
 
     /**
-     * @brief thread of managing task
+     * @brief time spent running tasks, in ns
      */
-    thread_t *task_list_manager;
+    unsigned long long busy_ns;
 
     /**
-     * @brief thread of managing thread
+     * @brief tasks added to own deque
      */
-    thread_t *thread_list_manager;
+    unsigned long long pushed;
 
     /**
-     * @brief lock of thread list;
+     * @brief time tasks waited in queue
      */
-    mutex_t *thread_list_lock;
+    pool_hist_t wait;
 
     /**
-     * @brief lock of task list;
+     * @brief time tasks ran
      */
-    mutex_t *task_list_lock;
+    pool_hist_t run;
 
     /**
-     * @brief deal with task add and remove
+     * @brief spin budget in ns, adapted by spin outcomes
      */
-    bsem_t *has_work;
+    unsigned long long spin_budget;
 
     /**
-     * @brief deal with task add and remove
+     * @brief times spun, times spinning found work, times slept
      */
-    bsem_t *has_idle_thread;
-};
-#define pidle_thread_list this->idle_thread_list
-#define pbusy_thread_list this->busy_thread_list
-#define ptask_list        this->task_list
-#define pool_min_size     this->min_size
-#define pool_cur_size     this->cur_size
-#define pool_max_size     this->max_size
-#define task_lock         this->task_list_lock
-#define task_manager      this->task_list_manager
-#define thread_manager    this->thread_list_manager
-#define pool_has_work     this->has_work
-#define has_idle_pthread  this->has_idle_thread
-#define pthread_list_lock this->thread_list_lock
+    unsigned long long spins;
+    unsigned long long spin_hits;
+    unsigned long long parks;
 
-static linked_list_t *pool_list = NULL;
-typedef struct thread_task_t thread_task_t;
-struct thread_task_t {
-    void (*work) (void *);
-    void *arg;
-};
+    /**
+     * @brief time from post to running again after sleep
+     */
+    pool_hist_t wake;
 
-thread_task_t *create_thread_task(void (*work) (void *), void *arg)
-{
-    thread_task_t *this;
+    /**
+     * @brief keeps counters of next slot off the last cache line
+     */
+    char pad[CACHE_LINE_SIZE];
+};
 
-#ifndef _WIN32
-    INIT(this,
-        .work = work,
-        .arg  = arg,
-    );
-#else
-    INIT(this, thread_task_t, 
-        work,
-        arg,
-    );
-#endif
+/**
+ * single writer add, readers may see old value but never a torn one
+ */
+#define STATS_ADD(counter, val) ATOMIC_STORE(&(counter), (counter) + (val))
 
-    return this;
-}
+typedef struct private_future_t private_future_t;
+typedef struct private_group_t private_group_t;
+typedef struct private_pool_t private_pool_t;
+typedef struct range_node_t range_node_t;
 
-typedef enum thread_state_t thread_state_t;
-enum thread_state_t {
-    THREAD_IDLE = 0,
-    THREAD_WORKING
+/**
+ * timer wheel levels, each of TIMER_SLOTS slots of one tick of the level
+ * below, level 0 ticks every ms
+ */
+#define TIMER_LEVELS     4
+#define TIMER_SLOT_BITS  8
+#define TIMER_SLOTS      (1 << TIMER_SLOT_BITS)
+#define TIMER_SLOT_MASK  (TIMER_SLOTS - 1)
+
+typedef enum timer_state_t timer_state_t;
+enum timer_state_t {
+    TIMER_PENDING = 0,
+    TIMER_QUEUED,
+    TIMER_RUNNING,
+    TIMER_DONE,
+    TIMER_CANCELLED,
 };
 
-typedef struct thread_pkg_t thread_pkg_t;
-struct thread_pkg_t {
+/**
+ * Timer of addjob_after and addjob_every.
+ */
+typedef struct private_timer_t private_timer_t;
+struct private_timer_t {
     /**
-     * @brief thread id
+     * @brief public interface
      */
-    int id;
+    pool_timer_t public;
 
     /**
-     * @brief control thread stop
+     * @brief pool running job
      */
-    int stop;
+    private_pool_t *pool;
 
     /**
-     * @brief thread state, idle or working
+     * @brief job
      */
-    thread_state_t state;
+    void (*job) (void *);
 
     /**
-     * @brief thread task
+     * @brief parameter of job
      */
-    thread_task_t *task;
+    void *arg;
 
     /**
-     * @brief task lock
+     * @brief tick to run at, monotonic ms
      */
-    mutex_t *lock;
+    unsigned long long expires;
 
     /**
-     * @brief thread
+     * @brief period in ms, 0 if runs once
      */
-    thread_t *thread;
+    unsigned int period;
 
     /**
-     * @brief wait_job
+     * @brief timer_state_t, guarded by timer_lock
      */
-    bsem_t *wait_job;
+    int state;
 
     /**
-     * @brief belong to
+     * @brief one for the handle, one for wheel or queued job
      */
-    private_pool_t *pool;
+    int refs;
 
     /**
-     * @brief thread start time
+     * @brief wheel slot holding timer
      */
-    tclock_t start_time;
+    private_timer_t **slot;
 
     /**
-     * @brief thread idle time
+     * @brief neighbours in wheel slot
      */
-    tclock_t idle_time;
+    private_timer_t *prev;
+    private_timer_t *next;
 };
-#define thread_pool_thread_list_lock this->pool->thread_list_lock
-#define thread_pool_has_idle_thread  this->pool->has_idle_thread
-
-thread_pkg_t *create_thread_pkg()
-{
-    thread_pkg_t *this;
-
-#ifndef _WIN32
-    INIT(this,
-        .id       = -1,
-        .stop     = 0,
-        .wait_job = NULL,
-        .thread   = NULL,
-    );
-#else
-    INIT(this, thread_pkg_t, 
-        -1,
-        0,
-        THREAD_IDLE,
-        NULL,
-        NULL,
-        NULL,
-        NULL,
-        NULL,
-        0,
-        0,
-    );
-#endif
-
-    return this;
-}
-
-/**
- * @brief thread handler 
- */
-static void thread_handler(thread_pkg_t *this)
-{
-    while (!this->stop) {
-        /**
-         * thread waiting for job
-         */ 
-        this->wait_job->wait(this->wait_job);
-        if (this->stop) break;
-
-        /**
-         * if has work to do
-         */
-        if (this->task && this->task->work != NULL) {
-            this->lock->lock(this->lock);
-            this->state = THREAD_WORKING;
-            this->task->work(this->task->arg);
-            free(this->task);
-            this->task = NULL;
-
-            thread_pool_thread_list_lock->lock(thread_pool_thread_list_lock);
-            GETCURRTIME(this->idle_time);
-            this->state = THREAD_IDLE;
-            thread_pool_thread_list_lock->unlock(thread_pool_thread_list_lock);
-            this->lock->unlock(this->lock);
-        } else {
-            this->wait_job->post(this->wait_job);
-        }
-    }
-}
 
 /**
- * @brief create new thread to thread pool
+ * Hashed hierarchical timing wheel, guarded by timer_lock.
  */
-static int thread_pkg_init(private_pool_t *this)
-{
-    thread_pkg_t *thread = NULL;
-
+typedef struct timer_wheel_t timer_wheel_t;
+struct timer_wheel_t {
     /**
-     * create thread information package
+     * @brief next tick to expire
      */
-    thread = create_thread_pkg();
-    if (!thread) return -1;
+    unsigned long long tick;
 
     /**
-     * create thread task
+     * @brief tick timer thread sleeps until, adding an earlier timer
+     *        wakes it up
      */
-    thread->task = create_thread_task(NULL, NULL);
-    if (!thread->task) return -1;
+    unsigned long long wake;
 
     /**
-     * create thread bsem and lock
+     * @brief count of timers in wheel
      */
-    thread->wait_job = bsem_create(0);
-    if (!thread->wait_job) return -1;
-    thread->lock = mutex_create();
-    if (!thread->lock) return -1;
+    int count;
 
     /**
-     * start task thread
+     * @brief slots
      */
-    thread->thread = thread_create((void *)thread_handler, thread);
-    if (!thread->thread) return -1;
+    private_timer_t *slots[TIMER_LEVELS][TIMER_SLOTS];
+};
 
+/**
+ * Job added with a key, waiting in its strand.
+ */
+typedef struct strand_job_t strand_job_t;
+struct strand_job_t {
     /**
-     * init thread information
+     * @brief task func
      */
-    thread->id    = thread->thread->get_id(thread->thread);
-    thread->state = THREAD_IDLE;
-    thread->pool  = this;
-    GETCURRTIME(thread->start_time);
+    void (*work) (void *);
 
     /**
-     * add thread to pool thread list
+     * @brief task arg
      */
-    pthread_list_lock->lock(pthread_list_lock);
-    pidle_thread_list->insert_last(pidle_thread_list, thread);
-    pool_cur_size++;
-    pthread_list_lock->unlock(pthread_list_lock);
-    has_idle_pthread->post(has_idle_pthread);
-
-    return 0;
-}
+    void *arg;
 
-static void thread_pkg_deinit(private_pool_t *this, thread_pkg_t *thread)
-{
     /**
-     * remove thread from pool thread list
+     * @brief next job of same key
      */
-    if (!thread) return;
+    strand_job_t *next;
+};
 
+/**
+ * Job added to a task group, linked in its group until it starts.
+ */
+typedef struct group_job_t group_job_t;
+struct group_job_t {
     /**
-     * stop thread
+     * @brief task func, NULL once cancelled
      */
-    thread->stop = 1;
-    USLEEP(10);
-    thread->wait_job->post(thread->wait_job);
-    USLEEP(10);
+    void (*work) (void *);
 
     /**
-     * free thread memory
+     * @brief task arg
      */
-    thread->wait_job->destroy(thread->wait_job);
-    thread->lock->destroy(thread->lock);
-    free(thread);
+    void *arg;
 
-    thread = NULL;
-    pool_cur_size--;
-}
+    /**
+     * @brief group of job, kept alive by job
+     */
+    private_group_t *group;
 
-METHOD(pool_t, destroy_, void, private_pool_t *this)
-{
-    int task_cnt   = 0;
-    int thread_cnt = 0;
-    thread_task_t *task  = NULL;
-    thread_pkg_t *thread = NULL;
+    /**
+     * @brief neighbours in queued jobs of group
+     */
+    group_job_t *prev;
+    group_job_t *next;
+};
 
+/**
+ * Jobs of one key, exists while it has jobs or is running, at most
+ * one pool task runs a strand at a time.
+ */
+typedef struct strand_t strand_t;
+struct strand_t {
     /**
-     * destroy manager thread 
+     * @brief key
      */
-    if (thread_manager) {
-        this->thread_manager_stop = 1;
-    }
+    unsigned long key;
 
     /**
-     * destroy manager thread and free memory
+     * @brief pool running strand
      */
-    if (task_manager) {
-        this->task_manager_stop = 1;
-        if (has_idle_pthread) has_idle_pthread->post(has_idle_pthread);
-        if (pool_has_work) pool_has_work->post(pool_has_work);
+    private_pool_t *pool;
 
-        USLEEP(10);
-        task_manager->cancel(task_manager);
-    }
+    /**
+     * @brief jobs in order of adding
+     */
+    strand_job_t *head;
+    strand_job_t *tail;
 
     /**
-     * destroy thread pool
+     * @brief next strand in bucket
      */
-    if (pidle_thread_list) {
-        pthread_list_lock->lock(pthread_list_lock);
-        thread_cnt = pidle_thread_list->get_count(pidle_thread_list);
-        pthread_list_lock->unlock(pthread_list_lock);
+    strand_t *next;
+};
 
-        while (thread_cnt-- > 0) {
-            pthread_list_lock->lock(pthread_list_lock);
-            pidle_thread_list->top(pidle_thread_list, (void **)&thread);
-            pthread_list_lock->unlock(pthread_list_lock);
-            thread_pkg_deinit(this, thread);
+/**
+ * Bucket of strand table, locks only its strands.
+ */
+typedef struct strand_bucket_t strand_bucket_t;
+struct strand_bucket_t {
+    /**
+     * @brief lock of strands and their jobs
+     */
+    mutex_t *lock;
 
-			thread = NULL;
-        }
-        free(pidle_thread_list);
-    }
-    if (pbusy_thread_list) {
-        pthread_list_lock->lock(pthread_list_lock);
-        thread_cnt = pbusy_thread_list->get_count(pbusy_thread_list);
-        pthread_list_lock->unlock(pthread_list_lock);
+    /**
+     * @brief strands hashed to this bucket
+     */
+    strand_t *strands;
+};
+struct private_pool_t {
+    /**
+     * @brief public interface
+     */
+    pool_t public;
 
-        while (thread_cnt-- > 0) {
-            pthread_list_lock->lock(pthread_list_lock);
-            pbusy_thread_list->top(pbusy_thread_list, (void **)&thread);
-            pthread_list_lock->unlock(pthread_list_lock);
-            thread_pkg_deinit(this, thread);
-			thread = NULL;
-        }
-        free(pbusy_thread_list);
-    }
+    /**
+     * @brief enable or disable thread manager
+     */
+    int enable_thread_manager;
 
     /**
-     * free task
+     * @brief pool_flag_t combination
      */
-    if (ptask_list) {
-        task_cnt = ptask_list->get_count(ptask_list);
-        while (task_cnt-- > 0) {
-            ptask_list->remove_first(ptask_list, (void **)&task);
-            if (task) free(task);
+    int flags;
 
-			task = NULL;
-        }
-        free(ptask_list);
-    }
+    /**
+     * @brief control worker threads stop
+     */
+    int stop;
 
     /**
-     * free lock and wait_job
+     * @brief control thread manager thread stop
      */
-    if (pthread_list_lock) pthread_list_lock->destroy(pthread_list_lock);
-    if (task_lock) task_lock->destroy(task_lock);
-    if (pool_has_work) pool_has_work->destroy(pool_has_work);
-    if (has_idle_pthread) has_idle_pthread->destroy(has_idle_pthread);
-    free(this);
-}
+    int thread_manager_stop;
+
+    /**
+     * @brief thread pool size
+     */
+    int min_size;
+
+    /**
+     * @brief thread pool size
+     */
+    int cur_size;
+
+    /**
+     * @brief thread pool size
+     */
+    int max_size;
+
+    /**
+     * @brief grow pool when more tasks than this are queued and no
+     *        thread is idle
+     */
+    int grow_depth;
+
+    /**
+     * @brief grow pool when a task waited longer than this, in ns
+     */
+    long long grow_latency;
+
+    /**
+     * @brief idle thread above min_size exits after this, in ms
+     */
+    unsigned int idle_timeout;
+
+    /**
+     * @brief futex word, 1 when thread manager is asked to grow pool
+     */
+    int grow_pending;
+
+    /**
+     * @brief futex word, count of workers that started running, thread
+     *        manager waits on it for threads it added
+     */
+    int started;
+
+    /**
+     * @brief count of threads parked or going to park on has_work
+     */
+    int idle_size;
+
+    /**
+     * @brief worker thread slots, max_size entries, NULL if free
+     */
+    struct thread_pkg_t **workers;
+
+    /**
+     * @brief deque of each worker slot, only with POOL_WORK_STEALING,
+     *        allocated by first worker of slot so it is on its numa node
+     */
+    struct task_deque_t **deques;
+
+    /**
+     * @brief capacity of task queue
+     */
+    int queue_size;
+
+    /**
+     * @brief task in this pool
+     */
+    task_ring_t task_queue;
+
+    /**
+     * @brief thread of managing thread
+     */
+    thread_t *thread_list_manager;
+
+    /**
+     * @brief lock of thread list;
+     */
+    mutex_t *thread_list_lock;
+
+    /**
+     * @brief heap of tasks added with priority or deadline
+     */
+    prio_entry_t *prio_heap;
+
+    /**
+     * @brief count of tasks in prio_heap, read without lock
+     */
+    int prio_count;
+
+    /**
+     * @brief key of heap top, read without lock
+     */
+    long long prio_top;
+
+    /**
+     * @brief next prio_entry_t seq
+     */
+    unsigned long prio_seq;
+
+    /**
+     * @brief waiting time worth one priority level, in ns
+     */
+    long long prio_aging;
+
+    /**
+     * @brief lock of prio_heap
+     */
+    mutex_t *prio_lock;
+
+    /**
+     * @brief futex word, one token per idle worker claimed by
+     *        pool_wakeup, parked workers take a token and pull tasks
+     *        by themselves
+     */
+    int has_work;
+
+    /**
+     * @brief released futures, reused by addjob_future
+     */
+    private_future_t *future_free;
+
+    /**
+     * @brief lock of future_free
+     */
+    mutex_t *future_lock;
+
+    /**
+     * @brief strands of addjob_keyed, DFT_STRAND_BUCKETS buckets
+     */
+    strand_bucket_t *strands;
+
+    /**
+     * @brief worker slot i runs on cpus[i % cpu_count], none if 0
+     */
+    int *cpus;
+
+    /**
+     * @brief count of cpus
+     */
+    int cpu_count;
+
+    /**
+     * @brief counters of each worker slot
+     */
+    worker_stats_t *stats;
+
+    /**
+     * @brief tasks run by threads out of pool in pool_help
+     */
+    unsigned long long helped;
+
+    /**
+     * @brief set by shutdown, only running jobs may add jobs after it
+     */
+    int closed;
+
+    /**
+     * @brief futex word, bumped when last task finished after
+     *        shutdown, wakes up draining thread
+     */
+    int park_seq;
+
+    /**
+     * @brief timers, created with timer thread by first addjob_after
+     */
+    timer_wheel_t *wheel;
+
+    /**
+     * @brief thread expiring timers
+     */
+    thread_t *timer_thread;
+
+    /**
+     * @brief lock of wheel and timer states
+     */
+    mutex_t *timer_lock;
+
+    /**
+     * @brief futex word of timer thread, bumped to wake it up
+     */
+    int timer_seq;
+
+    /**
+     * @brief set to stop timer thread
+     */
+    int timer_stop;
+
+    /**
+     * @brief max spin budget of idle worker in ns, 0 if never spins
+     */
+    long long spin_max;
+
+    /**
+     * @brief count of workers spinning for work
+     */
+    int spin_size;
+
+    /**
+     * @brief time of latest post, for wake up latency
+     */
+    long long post_stamp;
+
+    /**
+     * @brief pool_overflow_t, what a full queue does to new jobs
+     */
+    int overflow;
+
+    /**
+     * @brief count of producers blocked on full queue
+     */
+    int space_waiters;
+
+    /**
+     * @brief futex word, bumped when a blocked producer may find room
+     */
+    int space_seq;
+
+    /**
+     * @brief jobs dropped for newer ones, and jobs run by producers
+     *        because queue was full
+     */
+    unsigned long long dropped;
+    unsigned long long caller_ran;
+
+    /**
+     * @brief worker local data hooks and their context
+     */
+    void *(*worker_init) (void *ctx);
+    void (*worker_exit) (void *local, void *ctx);
+    void *worker_ctx;
+};
+#define pworkers          this->workers
+#define pdeques           this->deques
+#define ptask_queue       (&this->task_queue)
+#define pool_min_size     this->min_size
+#define pool_cur_size     this->cur_size
+#define pool_max_size     this->max_size
+#define thread_manager    this->thread_list_manager
+#define pool_has_work     (&this->has_work)
+#define pthread_list_lock this->thread_list_lock
+
+/**
+ * continuation list of a done future
+ */
+#define FUTURE_DONE ((private_future_t *)1)
+
+/**
+ * continuation list of a future whose job was dropped
+ */
+#define FUTURE_DROPPED ((private_future_t *)2)
+
+struct private_future_t {
+    /**
+     * @brief public interface
+     */
+    future_t public;
+
+    /**
+     * @brief pool running job and continuations
+     */
+    private_pool_t *pool;
+
+    /**
+     * @brief 0 while job pending, 1 when done, futex word
+     */
+    int state;
+
+    /**
+     * @brief count of threads sleeping on state
+     */
+    int waiters;
+
+    /**
+     * @brief one for the handle, one for the pool until job done
+     */
+    int refs;
+
+    /**
+     * @brief job
+     */
+    void *(*job) (void *arg);
+
+    /**
+     * @brief continuation job, takes result of previous job
+     */
+    void *(*cont) (void *arg, void *result);
+
+    /**
+     * @brief parameter of job
+     */
+    void *arg;
+
+    /**
+     * @brief result of previous job, for continuation
+     */
+    void *prev_result;
+
+    /**
+     * @brief result of job
+     */
+    void *result;
+
+    /**
+     * @brief continuations to run when done, FUTURE_DONE when done,
+     *        FUTURE_DROPPED when job was dropped
+     */
+    private_future_t *conts;
+
+    /**
+     * @brief next continuation, or next in pool free list
+     */
+    private_future_t *next;
+};
+
+struct private_group_t {
+    /**
+     * @brief public interface
+     */
+    pool_group_t public;
+
+    /**
+     * @brief pool running jobs
+     */
+    private_pool_t *pool;
+
+    /**
+     * @brief lock of queued jobs
+     */
+    mutex_t *lock;
+
+    /**
+     * @brief jobs not started yet, newest first
+     */
+    group_job_t *queued;
+
+    /**
+     * @brief count of queued and running jobs, futex word
+     */
+    int active;
+
+    /**
+     * @brief count of threads sleeping on active
+     */
+    int waiters;
+
+    /**
+     * @brief one for the handle, one per job record
+     */
+    int refs;
+};
+
+/**
+ * process wide pool of pool_default(), never destroyed
+ */
+static private_pool_t *default_pool = NULL;
+
+/**
+ * Record of a deque task, strand job or group job, allocated from
+ * thread caches.
+ */
+typedef union task_rec_t task_rec_t;
+union task_rec_t {
+    thread_task_t task;
+    strand_job_t job;
+    group_job_t group_job;
+
+    /**
+     * free record, first one of a batch in depot links next batch
+     */
+    struct {
+        task_rec_t *next;
+        task_rec_t *next_batch;
+        int count;
+    } free;
+};
+
+/**
+ * free records a thread keeps, and moves to or from depot at once
+ */
+#define TASK_CACHE_SIZE  (256)
+#define TASK_BATCH_SIZE  (64)
+
+/**
+ * Free records of one thread, only touched by the thread itself.
+ */
+typedef struct task_cache_t task_cache_t;
+struct task_cache_t {
+    /**
+     * @brief free records
+     */
+    task_rec_t *head;
+
+    /**
+     * @brief count of free records
+     */
+    int count;
+};
+
+static THREAD_LOCAL task_cache_t task_cache = {0};
+
+/**
+ * batches of free records given back by threads, records freed by
+ * workers flow back to producers through here
+ */
+static task_rec_t *task_depot = NULL;
+static mutex_t *task_depot_lock = NULL;
+
+/**
+ * @brief lock of depot, created by first user
+ */
+static mutex_t *task_depot_get_lock()
+{
+    mutex_t *lock = ATOMIC_LOAD(&task_depot_lock), *expected = NULL;
+
+    if (lock) return lock;
+    lock = mutex_create();
+    if (!ATOMIC_CAS(&task_depot_lock, &expected, lock)) {
+        lock->destroy(lock);
+        lock = expected;
+    }
+
+    return lock;
+}
+
+/**
+ * @brief give up to TASK_BATCH_SIZE records of cache to depot
+ */
+static void task_cache_drain(task_cache_t *this)
+{
+    mutex_t *lock = task_depot_get_lock();
+    task_rec_t *batch = this->head, *last = this->head;
+    int cnt = 1;
+
+    if (!batch) return;
+    while (cnt < TASK_BATCH_SIZE && last->free.next) {
+        last = last->free.next;
+        cnt++;
+    }
+    this->head   = last->free.next;
+    this->count -= cnt;
+    last->free.next   = NULL;
+    batch->free.count = cnt;
+
+    lock->lock(lock);
+    batch->free.next_batch = task_depot;
+    ATOMIC_STORE(&task_depot, batch);
+    lock->unlock(lock);
+}
+
+/**
+ * @brief take a batch of depot into empty cache
+ */
+static void task_cache_refill(task_cache_t *this)
+{
+    mutex_t *lock = NULL;
+    task_rec_t *batch = NULL;
+
+    if (!ATOMIC_LOAD(&task_depot)) return;
+    lock = task_depot_get_lock();
+    lock->lock(lock);
+    batch = task_depot;
+    if (batch) ATOMIC_STORE(&task_depot, batch->free.next_batch);
+    lock->unlock(lock);
+    if (!batch) return;
+
+    this->head  = batch;
+    this->count = batch->free.count;
+}
+
+/**
+ * @brief get a record, from cache of calling thread if possible
+ */
+static void *task_rec_alloc()
+{
+    task_cache_t *cache = &task_cache;
+    task_rec_t *rec = NULL;
+
+    if (!cache->head) task_cache_refill(cache);
+    if (!cache->head) return malloc(sizeof(task_rec_t));
+
+    rec = cache->head;
+    cache->head = rec->free.next;
+    cache->count--;
+
+    return rec;
+}
+
+/**
+ * @brief put record in cache of calling thread, a full cache gives a
+ *        batch back to depot
+ */
+static void task_rec_free(void *ptr)
+{
+    task_cache_t *cache = &task_cache;
+    task_rec_t *rec = ptr;
+
+    if (!rec) return;
+    rec->free.next = cache->head;
+    cache->head = rec;
+    if (++cache->count >= TASK_CACHE_SIZE) task_cache_drain(cache);
+}
+
+/**
+ * @brief give all cached records to depot, when thread ends
+ */
+static void task_cache_flush()
+{
+    while (task_cache.head) task_cache_drain(&task_cache);
+}
+
+thread_task_t *create_thread_task(void (*work) (void *), void *arg)
+{
+    thread_task_t *this = task_rec_alloc();
+
+    if (!this) return NULL;
+    this->work  = work;
+    this->arg   = arg;
+    this->stamp = monotonic_ns();
+
+    return this;
+}
+
+/**
+ * @brief init task ring, capacity rounded up to power of 2, at least 2
+ *        since a ring of 1 cell can not tell full from free
+ */
+static int task_ring_init(task_ring_t *this, int size)
+{
+    unsigned long i = 0, cap = 2;
+
+    while (cap < (unsigned long)size) cap <<= 1;
+    this->cells = malloc(cap * sizeof(task_cell_t));
+    if (!this->cells) return -1;
+
+    for (i = 0; i < cap; i++) {
+        this->cells[i].seq = i;
+    }
+    this->mask        = cap - 1;
+    this->enqueue_pos = 0;
+    this->dequeue_pos = 0;
+
+    return 0;
+}
+
+/**
+ * @brief copy task into ring
+ *
+ * @return 0 if succ, -1 if ring is full
+ */
+static int task_ring_push(task_ring_t *this, thread_task_t *task)
+{
+    task_cell_t *cell = NULL;
+    unsigned long pos = ATOMIC_LOAD(&this->enqueue_pos);
+    long dif = 0;
+
+    while (1) {
+        cell = &this->cells[pos & this->mask];
+        dif  = (long)ATOMIC_LOAD(&cell->seq) - (long)pos;
+        if (dif == 0) {
+            if (ATOMIC_CAS(&this->enqueue_pos, &pos, pos + 1)) break;
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = ATOMIC_LOAD(&this->enqueue_pos);
+        }
+    }
+
+    cell->task = *task;
+    ATOMIC_STORE(&cell->seq, pos + 1);
+
+    return 0;
+}
+
+/**
+ * @brief copy as many of n jobs as fit into ring with one reservation
+ *
+ * @return count of jobs pushed, 0 if ring is full
+ */
+static int task_ring_push_n(task_ring_t *this, void (*job[]) (void *), void *arg[], int n)
+{
+    task_cell_t *cell = NULL;
+    unsigned long pos = ATOMIC_LOAD(&this->enqueue_pos);
+    long long stamp = monotonic_ns();
+    long dif = 0;
+    int i = 0, cnt = 0;
+
+    while (1) {
+        /**
+         * count free slots in a row from pos
+         */
+        for (cnt = 0; cnt < n; cnt++) {
+            cell = &this->cells[(pos + cnt) & this->mask];
+            dif  = (long)ATOMIC_LOAD(&cell->seq) - (long)(pos + cnt);
+            if (dif != 0) break;
+        }
+
+        if (cnt > 0) {
+            if (ATOMIC_CAS(&this->enqueue_pos, &pos, pos + cnt)) break;
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = ATOMIC_LOAD(&this->enqueue_pos);
+        }
+    }
+
+    for (i = 0; i < cnt; i++) {
+        cell = &this->cells[(pos + i) & this->mask];
+        cell->task.work  = job[i];
+        cell->task.arg   = arg ? arg[i] : NULL;
+        cell->task.stamp = stamp;
+        ATOMIC_STORE(&cell->seq, pos + i + 1);
+    }
+
+    return cnt;
+}
+
+/**
+ * @brief copy oldest task out of ring
+ *
+ * @return 0 if succ, -1 if ring is empty
+ */
+static int task_ring_pop(task_ring_t *this, thread_task_t *task)
+{
+    task_cell_t *cell = NULL;
+    unsigned long pos = ATOMIC_LOAD(&this->dequeue_pos);
+    long dif = 0;
+
+    while (1) {
+        cell = &this->cells[pos & this->mask];
+        dif  = (long)ATOMIC_LOAD(&cell->seq) - (long)(pos + 1);
+        if (dif == 0) {
+            if (ATOMIC_CAS(&this->dequeue_pos, &pos, pos + 1)) break;
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = ATOMIC_LOAD(&this->dequeue_pos);
+        }
+    }
+
+    *task = cell->task;
+    ATOMIC_STORE(&cell->seq, pos + this->mask + 1);
+
+    return 0;
+}
+
+/**
+ * @brief add time of oldest task in ring, a snapshot only, read
+ *        without taking the task
+ *
+ * @return monotonic ns, -1 if ring is empty
+ */
+static long long task_ring_head_stamp(task_ring_t *this)
+{
+    unsigned long pos = ATOMIC_LOAD(&this->dequeue_pos);
+    task_cell_t *cell = &this->cells[pos & this->mask];
+
+    if (ATOMIC_LOAD(&cell->seq) != pos + 1) return -1;
+    return cell->task.stamp;
+}
+
+/**
+ * @brief count of tasks in ring, a snapshot only
+ */
+static int task_ring_count(task_ring_t *this)
+{
+    long cnt = (long)(ATOMIC_LOAD(&this->enqueue_pos) - ATOMIC_LOAD(&this->dequeue_pos));
+
+    return cnt < 0 ? 0 : (int)cnt;
+}
+
+/**
+ * Chase-Lev work stealing deque of one worker slot. Only the owner
+ * pushes and pops at bottom, other workers steal at top.
+ */
+typedef struct task_deque_t task_deque_t;
+struct task_deque_t {
+    /**
+     * @brief next index to steal, written by thieves
+     */
+    long top;
+    char top_pad[CACHE_LINE_SIZE - sizeof(long)];
+
+    /**
+     * @brief next index to push, written by owner
+     */
+    long bottom;
+    char bottom_pad[CACHE_LINE_SIZE - sizeof(long)];
+
+    /**
+     * @brief task ring, DFT_WORKER_DEQUE_SIZE must be power of 2
+     */
+    thread_task_t *tasks[DFT_WORKER_DEQUE_SIZE];
+};
+#define DEQUE_MASK (DFT_WORKER_DEQUE_SIZE - 1)
+
+/**
+ * @brief owner pushes task at bottom
+ *
+ * @return 0 if succ, -1 if deque is full
+ */
+static int deque_push(task_deque_t *this, thread_task_t *task)
+{
+    long b = this->bottom;
+    long t = ATOMIC_LOAD(&this->top);
+
+    if (b - t >= DFT_WORKER_DEQUE_SIZE) return -1;
+    ATOMIC_STORE(&this->tasks[b & DEQUE_MASK], task);
+    ATOMIC_STORE(&this->bottom, b + 1);
+
+    return 0;
+}
+
+/**
+ * @brief owner pops the task pushed last
+ */
+static thread_task_t *deque_pop(task_deque_t *this)
+{
+    long b = this->bottom - 1;
+    long t = 0;
+    thread_task_t *task = NULL;
+
+    ATOMIC_XCHG(&this->bottom, b);
+    t = ATOMIC_LOAD(&this->top);
+    if (t > b) {
+        ATOMIC_STORE(&this->bottom, b + 1);
+        return NULL;
+    }
+
+    task = ATOMIC_LOAD(&this->tasks[b & DEQUE_MASK]);
+    if (t == b) {
+        /**
+         * last task, race with thieves
+         */
+        if (!ATOMIC_CAS(&this->top, &t, t + 1)) task = NULL;
+        ATOMIC_STORE(&this->bottom, b + 1);
+    }
+
+    return task;
+}
+
+/**
+ * @brief other worker steals the oldest task
+ */
+static thread_task_t *deque_steal(task_deque_t *this)
+{
+    long t = ATOMIC_LOAD(&this->top);
+    long b = 0;
+    thread_task_t *task = NULL;
+
+    ATOMIC_FENCE();
+    b = ATOMIC_LOAD(&this->bottom);
+    if (t >= b) return NULL;
+
+    task = ATOMIC_LOAD(&this->tasks[t & DEQUE_MASK]);
+    if (!ATOMIC_CAS(&this->top, &t, t + 1)) return NULL;
+
+    return task;
+}
+
+typedef enum thread_state_t thread_state_t;
+enum thread_state_t {
+    THREAD_IDLE = 0,
+    THREAD_WORKING
+};
+
+typedef struct thread_pkg_t thread_pkg_t;
+struct thread_pkg_t {
+    /**
+     * @brief thread id
+     */
+    int id;
+
+    /**
+     * @brief index of worker slot in pool
+     */
+    int index;
+
+    /**
+     * @brief seed of choosing steal victim
+     */
+    unsigned int seed;
+
+    /**
+     * @brief thread state, idle or working
+     */
+    thread_state_t state;
+
+    /**
+     * @brief thread
+     */
+    thread_t *thread;
+
+    /**
+     * @brief belong to
+     */
+    private_pool_t *pool;
+
+    /**
+     * @brief thread start time
+     */
+    tclock_t start_time;
+
+    /**
+     * @brief thread idle time
+     */
+    tclock_t idle_time;
+
+    /**
+     * @brief result of worker_init, handed to worker_exit
+     */
+    void *local;
+};
+#define thread_pool_stop             ATOMIC_LOAD(&this->pool->stop)
+#define thread_pool_cur_size         this->pool->cur_size
+#define thread_pool_workers          this->pool->workers
+#define thread_pool_thread_list_lock this->pool->thread_list_lock
+
+/**
+ * @brief worker running in current thread, NULL if not a pool thread
+ */
+static THREAD_LOCAL thread_pkg_t *current_worker = NULL;
+
+/**
+ * @brief pool whose timer thread is current thread, NULL if none
+ */
+static THREAD_LOCAL private_pool_t *current_timer_pool = NULL;
+
+thread_pkg_t *create_thread_pkg()
+{
+    thread_pkg_t *this;
+
+#ifndef _WIN32
+    INIT(this,
+        .id     = -1,
+        .index  = -1,
+        .seed   = 0,
+        .state  = THREAD_IDLE,
+        .thread = NULL,
+        .local  = NULL,
+    );
+#else
+    INIT(this, thread_pkg_t,
+        -1,
+        -1,
+        0,
+        THREAD_IDLE,
+        NULL,
+        NULL,
+        0,
+        0,
+        NULL,
+    );
+#endif
+
+    return this;
+}
+
+/**
+ * @brief a task left a queue, wake up producers blocked on full queue,
+ *        all of them since they may wait for ring or heap
+ */
+static void pool_space(private_pool_t *this)
+{
+    if (this->overflow != POOL_OVERFLOW_BLOCK) return;
+
+    /**
+     * pairs with producer counting itself before retrying push
+     */
+    ATOMIC_FENCE();
+    if (ATOMIC_LOAD(&this->space_waiters) <= 0) return;
+    ATOMIC_ADD(&this->space_seq, 1);
+    futex_wake(&this->space_seq, INT_MAX);
+}
+
+/**
+ * @brief whether heap entry a runs before b
+ */
+static int prio_before(prio_entry_t *a, prio_entry_t *b)
+{
+    if (a->key != b->key) return a->key < b->key;
+    return (long)(a->seq - b->seq) < 0;
+}
+
+/**
+ * @brief add task to priority heap
+ *
+ * @return 0 if succ, -1 if heap is full
+ */
+static int prio_push(private_pool_t *this, thread_task_t *task, long long key)
+{
+    prio_entry_t entry = {0};
+    int i = 0, parent = 0;
+
+    this->prio_lock->lock(this->prio_lock);
+    if (!this->prio_heap) {
+        this->prio_heap = malloc(this->queue_size * sizeof(prio_entry_t));
+    }
+    if (!this->prio_heap || this->prio_count >= this->queue_size) {
+        this->prio_lock->unlock(this->prio_lock);
+        return -1;
+    }
+
+    entry.key  = key;
+    entry.seq  = this->prio_seq++;
+    entry.task = *task;
+
+    /**
+     * sift up
+     */
+    i = this->prio_count;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!prio_before(&entry, &this->prio_heap[parent])) break;
+        this->prio_heap[i] = this->prio_heap[parent];
+        i = parent;
+    }
+    this->prio_heap[i] = entry;
+
+    ATOMIC_STORE(&this->prio_top, this->prio_heap[0].key);
+    ATOMIC_STORE(&this->prio_count, this->prio_count + 1);
+    this->prio_lock->unlock(this->prio_lock);
+
+    return 0;
+}
+
+/**
+ * @brief take most urgent task of priority heap
+ *
+ * @param urgent  only take it if it is due before a task added now with
+ *                normal priority and before the oldest task in ring
+ * @return        0 if taken, -1 otherwise
+ */
+static int prio_pop(private_pool_t *this, int urgent, thread_task_t *task)
+{
+    prio_entry_t last = {0};
+    long long key = 0, head = 0;
+    int i = 0, child = 0, cnt = 0;
+
+    if (ATOMIC_LOAD(&this->prio_count) <= 0) return -1;
+
+    if (urgent) {
+        key = ATOMIC_LOAD(&this->prio_top);
+        if (key > monotonic_ns() + this->prio_aging) return -1;
+        head = task_ring_head_stamp(ptask_queue);
+        if (head >= 0 && key > head + this->prio_aging) return -1;
+    }
+
+    this->prio_lock->lock(this->prio_lock);
+    cnt = this->prio_count;
+    if (cnt <= 0) {
+        this->prio_lock->unlock(this->prio_lock);
+        return -1;
+    }
+    *task = this->prio_heap[0].task;
+
+    /**
+     * sift last entry down from top
+     */
+    last = this->prio_heap[--cnt];
+    while ((child = 2 * i + 1) < cnt) {
+        if (child + 1 < cnt && prio_before(&this->prio_heap[child + 1], &this->prio_heap[child])) child++;
+        if (!prio_before(&this->prio_heap[child], &last)) break;
+        this->prio_heap[i] = this->prio_heap[child];
+        i = child;
+    }
+    if (cnt > 0) {
+        this->prio_heap[i] = last;
+        ATOMIC_STORE(&this->prio_top, this->prio_heap[0].key);
+    }
+    ATOMIC_STORE(&this->prio_count, cnt);
+    this->prio_lock->unlock(this->prio_lock);
+    pool_space(this);
+
+    return 0;
+}
+
+/**
+ * @brief count of queued tasks, a snapshot only
+ */
+static int pool_queued(private_pool_t *this)
+{
+    return task_ring_count(ptask_queue) + ATOMIC_LOAD(&this->prio_count);
+}
+
+/**
+ * @brief whether pool takes new jobs, after shutdown only jobs added by
+ *        its running jobs while draining
+ */
+static int pool_accepting(private_pool_t *this)
+{
+    if (!ATOMIC_LOAD(&this->closed)) return 1;
+    return !ATOMIC_LOAD(&this->stop) && current_worker && current_worker->pool == this;
+}
+
+/**
+ * @brief whether every task added so far has finished
+ *
+ * a task is counted as added before anybody can take it, and as done
+ * after it returned, so reading done counters first can only see them
+ * equal when nothing was queued or running in between
+ */
+static int pool_quiescent(private_pool_t *this)
+{
+    unsigned long long done = 0, added = 0;
+    int i = 0;
+
+    done = ATOMIC_LOAD(&this->helped) + ATOMIC_LOAD(&this->dropped);
+    for (i = 0; i < pool_max_size; i++) done += ATOMIC_LOAD(&this->stats[i].completed);
+
+    added = ATOMIC_LOAD(&ptask_queue->enqueue_pos);
+    for (i = 0; i < pool_max_size; i++) added += ATOMIC_LOAD(&this->stats[i].pushed);
+    this->prio_lock->lock(this->prio_lock);
+    added += this->prio_seq;
+    this->prio_lock->unlock(this->prio_lock);
+
+    return done == added;
+}
+
+/**
+ * @brief called after a task finished, the one finishing last task of
+ *        closed pool wakes up draining shutdown
+ */
+static void pool_drained(private_pool_t *this)
+{
+    if (!ATOMIC_LOAD(&this->closed) || !pool_quiescent(this)) return;
+    ATOMIC_ADD(&this->park_seq, 1);
+    futex_wake(&this->park_seq, 1);
+}
+
+/**
+ * @brief give cnt tokens to parked workers with one wake up
+ */
+static void pool_post(private_pool_t *this, int cnt)
+{
+    if (cnt <= 0) return;
+    ATOMIC_STORE(&this->post_stamp, monotonic_ns());
+    ATOMIC_ADD(pool_has_work, cnt);
+    futex_wake(pool_has_work, cnt);
+}
+
+/**
+ * @brief park until a token is given by pool_post
+ */
+static void pool_wait(private_pool_t *this)
+{
+    int tokens = ATOMIC_LOAD(pool_has_work);
+
+    while (1) {
+        if (tokens > 0) {
+            if (ATOMIC_CAS(pool_has_work, &tokens, tokens - 1)) return;
+            continue;
+        }
+        futex_wait(pool_has_work, 0);
+        tokens = ATOMIC_LOAD(pool_has_work);
+    }
+}
+
+/**
+ * @brief park until a token is given by pool_post, at most timeout ms
+ *
+ * @return 0 if token taken, -1 if timed out
+ */
+static int pool_timed_wait(private_pool_t *this, unsigned int timeout)
+{
+    long long deadline = monotonic_ms() + timeout;
+    long long left     = timeout;
+    int tokens = ATOMIC_LOAD(pool_has_work);
+
+    while (1) {
+        if (tokens > 0) {
+            if (ATOMIC_CAS(pool_has_work, &tokens, tokens - 1)) return 0;
+            continue;
+        }
+        if (left <= 0) return -1;
+        futex_timed_wait(pool_has_work, 0, (unsigned int)left);
+        tokens = ATOMIC_LOAD(pool_has_work);
+        left   = deadline - monotonic_ms();
+    }
+}
+
+/**
+ * @brief ask thread manager to add threads, never blocks
+ */
+static void pool_grow(private_pool_t *this)
+{
+    int pending = 0;
+
+    if (!thread_manager || ATOMIC_LOAD(&pool_cur_size) >= pool_max_size) return;
+    if (ATOMIC_CAS(&this->grow_pending, &pending, 1)) {
+        futex_wake(&this->grow_pending, 1);
+    }
+}
+
+/**
+ * @brief take back one idle worker registration
+ *
+ * @return 1 if taken, 0 if all idle workers are already claimed
+ */
+static int pool_unidle(private_pool_t *this)
+{
+    int idle = ATOMIC_LOAD(&this->idle_size);
+
+    while (idle > 0) {
+        if (ATOMIC_CAS(&this->idle_size, &idle, idle - 1)) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief wake up min(cnt, idle) parked workers at once, grow pool if
+ *        tasks pile up with no idle worker left
+ */
+static void pool_wakeup(private_pool_t *this, int cnt)
+{
+    int idle = 0, claim = 0;
+
+    /**
+     * order task publishing before reading idle_size, pairs with
+     * the recheck in thread_park
+     */
+    ATOMIC_FENCE();
+    idle = ATOMIC_LOAD(&this->idle_size);
+    while (idle > 0 && cnt > 0) {
+        claim = idle < cnt ? idle : cnt;
+        if (ATOMIC_CAS(&this->idle_size, &idle, idle - claim)) {
+            pool_post(this, claim);
+            cnt -= claim;
+            break;
+        }
+    }
+
+    /**
+     * spinning workers pick tasks up soon, they are no reason to grow
+     */
+    if (cnt > ATOMIC_LOAD(&this->spin_size) && pool_queued(this) > this->grow_depth) {
+        pool_grow(this);
+    }
+}
+
+/**
+ * @brief pool task queue, priority heap, then steal from worker deques
+ *
+ * @param skip  worker slot not to steal from, -1 for none
+ * @param seed  [in/out] seed of choosing steal victim
+ * @param task  [out] task found
+ * @return      0 if found, -1 if nothing to do
+ */
+static int pool_take_task(private_pool_t *this, int skip, unsigned int *seed, thread_task_t *task)
+{
+    thread_task_t *local = NULL;
+    int i = 0, victim = 0;
+
+    if (task_ring_pop(ptask_queue, task) == 0) {
+        pool_space(this);
+        return 0;
+    }
+    if (prio_pop(this, 0, task) == 0) return 0;
+    if (!pdeques) return -1;
+
+    *seed  = *seed * 1103515245 + 12345;
+    victim = (*seed >> 16) % pool_max_size;
+    for (i = 0; i < pool_max_size; i++, victim = (victim + 1) % pool_max_size) {
+        if (victim == skip) continue;
+        if (!ATOMIC_LOAD(&pdeques[victim])) continue;
+        local = deque_steal(pdeques[victim]);
+        if (!local) continue;
+
+        *task = *local;
+        task_rec_free(local);
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief find a task for worker: urgent priority task, own deque, pool
+ *        task queue, other priority task, then steal from other workers
+ *
+ * @param task  [out] task found
+ * @return      0 if found, -1 if nothing to do
+ */
+static int thread_take_task(thread_pkg_t *this, thread_task_t *task)
+{
+    thread_task_t *local = NULL;
+
+    if (prio_pop(this->pool, 1, task) == 0) return 0;
+
+    if (this->pool->deques && this->pool->deques[this->index]) {
+        local = deque_pop(this->pool->deques[this->index]);
+        if (local) {
+            *task = *local;
+            task_rec_free(local);
+            return 0;
+        }
+    }
+
+    return pool_take_task(this->pool, this->index, &this->seed, task);
+}
+
+/**
+ * @brief run task taken from pool queues in calling thread, count it done
+ */
+static void pool_run_task(private_pool_t *this, thread_task_t *task)
+{
+    if (task->work != NULL) task->work(task->arg);
+    if (current_worker && current_worker->pool == this) {
+        STATS_ADD(this->stats[current_worker->index].completed, 1);
+    } else {
+        ATOMIC_ADD(&this->helped, 1);
+    }
+    pool_drained(this);
+}
+
+/**
+ * @brief run one pending task of pool in calling thread, lets a thread
+ *        waiting for its own jobs help instead of blocking
+ *
+ * @return 0 if a task was run, -1 if nothing to do
+ */
+static int pool_help(private_pool_t *this)
+{
+    static THREAD_LOCAL unsigned int seed = 0;
+    thread_task_t task = {0};
+
+    if (current_worker && current_worker->pool == this) {
+        if (thread_take_task(current_worker, &task) != 0) return -1;
+    } else {
+        if (prio_pop(this, 1, &task) != 0 &&
+            pool_take_task(this, -1, &seed, &task) != 0) return -1;
+    }
+
+    pool_run_task(this, &task);
+
+    return 0;
+}
+
+/**
+ * pauses between polls while spinning, doubled up to this
+ */
+#define SPIN_PAUSE_MAX 64
+
+/**
+ * @brief spin for a task before parking, budget doubles when work came
+ *        while spinning and halves when it did not
+ *
+ * @param task  [out] task found
+ * @return      0 if found, -1 if nothing to do
+ */
+static int thread_spin(thread_pkg_t *this, thread_task_t *task)
+{
+    private_pool_t *pool = this->pool;
+    worker_stats_t *stats = &pool->stats[this->index];
+    long long budget = stats->spin_budget, start = 0;
+    int pause = 1, i = 0, found = 0;
+
+    if (budget <= 0) return -1;
+
+    ATOMIC_ADD(&pool->spin_size, 1);
+    start = monotonic_ns();
+    while (!thread_pool_stop) {
+        for (i = 0; i < pause; i++) CPU_RELAX();
+        if (pause < SPIN_PAUSE_MAX) pause <<= 1;
+        if (thread_take_task(this, task) == 0) {
+            found = 1;
+            break;
+        }
+        if (monotonic_ns() - start > budget) break;
+    }
+    ATOMIC_SUB(&pool->spin_size, 1);
+
+    STATS_ADD(stats->spins, 1);
+    if (found) {
+        STATS_ADD(stats->spin_hits, 1);
+        budget = budget * 2 < pool->spin_max ? budget * 2 : pool->spin_max;
+    } else {
+        budget = budget / 2 > pool->spin_max / 8 ? budget / 2 : pool->spin_max / 8;
+    }
+    ATOMIC_STORE(&stats->spin_budget, budget);
+
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief park worker until pool_wakeup claims it or idle timeout
+ *
+ * @param task  [out] task found while going to park
+ * @return      0 if task found, -1 after woken up, 1 if timed out
+ */
+static int thread_park(thread_pkg_t *this, thread_task_t *task)
+{
+    worker_stats_t *stats = &this->pool->stats[this->index];
+    long long wake = 0;
+    int found = 0;
+
+    ATOMIC_ADD(&this->pool->idle_size, 1);
+
+    /**
+     * recheck after registering as idle, task added before this
+     * point did not see us
+     */
+    found = thread_take_task(this, task) == 0;
+    if (found || thread_pool_stop) {
+        /**
+         * a post is on its way if somebody claimed us already
+         */
+        if (!pool_unidle(this->pool)) pool_wait(this->pool);
+        return found ? 0 : -1;
+    }
+
+    STATS_ADD(stats->parks, 1);
+    if (pool_timed_wait(this->pool, this->pool->idle_timeout) == 0) {
+        wake = monotonic_ns() - ATOMIC_LOAD(&this->pool->post_stamp);
+        STATS_ADD(stats->wake.count[pool_hist_bucket(wake > 0 ? wake : 0)], 1);
+        return -1;
+    }
+    if (!pool_unidle(this->pool)) {
+        pool_wait(this->pool);
+        return -1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief hand worker local data to worker_exit, once per worker
+ */
+static void thread_local_exit(thread_pkg_t *this)
+{
+    if (this->pool->worker_exit) this->pool->worker_exit(this->local, this->pool->worker_ctx);
+    this->local = NULL;
+}
+
+/**
+ * @brief take idle thread out of pool while pool is above min size
+ *
+ * @return 1 if this thread is retired and freed, 0 otherwise
+ */
+static int thread_retire(thread_pkg_t *this)
+{
+    thread_t *thread = NULL;
+
+    thread_pool_thread_list_lock->lock(thread_pool_thread_list_lock);
+    if (thread_pool_stop || thread_pool_cur_size <= this->pool->min_size) {
+        thread_pool_thread_list_lock->unlock(thread_pool_thread_list_lock);
+        return 0;
+    }
+    ATOMIC_SUB(&thread_pool_cur_size, 1);
+
+    /**
+     * still under lock, destroy can not free pool before local is gone
+     */
+    thread_local_exit(this);
+    thread_pool_workers[this->index] = NULL;
+    thread_pool_thread_list_lock->unlock(thread_pool_thread_list_lock);
+
+    /**
+     * nobody joins a retired thread, so let it clean up by itself
+     */
+    thread = this->thread;
+    free(this);
+    thread->detach(thread);
+
+    return 1;
+}
+
+static void group_run(group_job_t *this);
+static void group_drop(group_job_t *this);
+static void timer_run(private_timer_t *this);
+static void timer_unref(private_timer_t *this);
+static void future_run(private_future_t *this);
+static void future_drop(private_future_t *this);
+
+/**
+ * @brief drop task of stopped pool instead of running it, group jobs are
+ *        cancelled so waiters of their groups return, timers and futures
+ *        give the reference of their job back
+ */
+static void pool_drop_task(thread_task_t *task)
+{
+    if (task->work == (void *)group_run) group_drop(task->arg);
+    else if (task->work == (void *)timer_run) timer_unref(task->arg);
+    else if (task->work == (void *)future_run) future_drop(task->arg);
+}
+
+/**
+ * @brief thread handler
+ */
+static void thread_handler(thread_pkg_t *this)
+{
+    thread_task_t task = {0};
+    task_deque_t *deque = NULL;
+    worker_stats_t *stats = &this->pool->stats[this->index];
+    long long start = 0, end = 0;
+    int ret = 0, cpu = 0;
+
+    current_worker = this;
+    ATOMIC_ADD(&this->pool->started, 1);
+    futex_wake(&this->pool->started, 1);
+
+    /**
+     * move to cpu of slot before touching any memory of own, thread
+     * handle is published under lock by thread_pkg_init
+     */
+    if (this->pool->cpu_count > 0) {
+        thread_pool_thread_list_lock->lock(thread_pool_thread_list_lock);
+        thread_pool_thread_list_lock->unlock(thread_pool_thread_list_lock);
+        cpu = this->pool->cpus[this->index % this->pool->cpu_count];
+        this->thread->set_affinity(this->thread, &cpu, 1);
+    }
+
+    /**
+     * first worker of slot allocates its deque, pages are first touched
+     * here so they stay local to the worker
+     */
+    if (this->pool->deques && !this->pool->deques[this->index]) {
+        deque = calloc(1, sizeof(task_deque_t));
+        if (deque) ATOMIC_STORE(&this->pool->deques[this->index], deque);
+    }
+    if (this->pool->worker_init) this->local = this->pool->worker_init(this->pool->worker_ctx);
+    while (!thread_pool_stop) {
+        /**
+         * pull job by worker itself, spin a while then park if nothing
+         * to do, own deque is empty when parking timed out, safe to
+         * leave the pool
+         */
+        if (thread_take_task(this, &task) != 0 && thread_spin(this, &task) != 0) {
+            ret = thread_park(this, &task);
+            if (ret == 1 && thread_retire(this)) goto retired;
+            if (ret != 0) continue;
+        }
+        if (thread_pool_stop) {
+            pool_drop_task(&task);
+            break;
+        }
+
+        /**
+         * task waited too long and nobody is idle, pool is too small
+         */
+        start = monotonic_ns();
+        if (start - task.stamp > this->pool->grow_latency &&
+            ATOMIC_LOAD(&this->pool->idle_size) == 0) {
+            pool_grow(this->pool);
+        }
+
+        /**
+         * has work to do
+         */
+        this->state = THREAD_WORKING;
+        if (task.work != NULL) task.work(task.arg);
+
+        end = monotonic_ns();
+        STATS_ADD(stats->completed, 1);
+        STATS_ADD(stats->busy_ns, end - start);
+        STATS_ADD(stats->wait.count[pool_hist_bucket(start - task.stamp)], 1);
+        STATS_ADD(stats->run.count[pool_hist_bucket(end - start)], 1);
+        pool_drained(this->pool);
+
+        GETCURRTIME(this->idle_time);
+        this->state = THREAD_IDLE;
+    }
+    thread_local_exit(this);
+
+retired:
+    /**
+     * records cached by this thread go back for other threads, pkg is
+     * freed by retiring already
+     */
+    task_cache_flush();
+}
+
+/**
+ * @brief create new thread to thread pool
+ */
+static int thread_pkg_init(private_pool_t *this)
+{
+    thread_pkg_t *thread = NULL;
+    int i = 0;
+
+    /**
+     * create thread information package
+     */
+    thread = create_thread_pkg();
+    if (!thread) return -1;
+
+    /**
+     * init thread information before it starts pulling jobs
+     */
+    thread->state = THREAD_IDLE;
+    thread->pool  = this;
+    GETCURRTIME(thread->start_time);
+    thread->idle_time = thread->start_time;
+
+    /**
+     * take a free worker slot, so that destroy always finds it
+     */
+    pthread_list_lock->lock(pthread_list_lock);
+    for (i = 0; i < pool_max_size; i++) {
+        if (!pworkers[i]) break;
+    }
+    if (i >= pool_max_size) {
+        pthread_list_lock->unlock(pthread_list_lock);
+        free(thread);
+        return -1;
+    }
+    thread->index = i;
+    thread->seed  = (unsigned int)i;
+
+    thread->thread = thread_create((void *)thread_handler, thread);
+    if (!thread->thread) {
+        pthread_list_lock->unlock(pthread_list_lock);
+        free(thread);
+        return -1;
+    }
+    thread->id = thread->thread->get_id(thread->thread);
+    pworkers[i] = thread;
+    ATOMIC_ADD(&pool_cur_size, 1);
+    pthread_list_lock->unlock(pthread_list_lock);
+
+    return 0;
+}
+
+/**
+ * @brief empty queues of stopped pool, queued group jobs are cancelled
+ *        so waiters of their groups return
+ */
+static void pool_drop_queued(private_pool_t *this)
+{
+    thread_task_t task = {0};
+    thread_task_t *ltask = NULL;
+    int i = 0;
+
+    while (task_ring_pop(ptask_queue, &task) == 0 || prio_pop(this, 0, &task) == 0) {
+        pool_drop_task(&task);
+    }
+    if (!pdeques) return;
+    for (i = 0; i < pool_max_size; i++) {
+        if (!pdeques[i]) continue;
+        while ((ltask = deque_pop(pdeques[i])) != NULL) {
+            pool_drop_task(ltask);
+            task_rec_free(ltask);
+        }
+    }
+}
+
+/**
+ * @brief whether current thread is one shutdown joins, a worker or timer
+ *        thread of pool
+ */
+static int pool_own_thread(private_pool_t *this)
+{
+    return (current_worker && current_worker->pool == this) || current_timer_pool == this;
+}
+
+METHOD(pool_t, shutdown_, int, private_pool_t *this, pool_shutdown_t mode)
+{
+    int i = 0;
+    int thread_cnt = 0;
+    int seq = 0;
+
+    /**
+     * default pool is shared by the whole process, a thread of pool would
+     * join itself
+     */
+    if (this == ATOMIC_LOAD(&default_pool) || pool_own_thread(this)) return -1;
+    if (ATOMIC_XCHG(&this->closed, 1)) return -1;
+
+    /**
+     * producers blocked on full queue give up
+     */
+    ATOMIC_ADD(&this->space_seq, 1);
+    futex_wake(&this->space_seq, INT_MAX);
+
+    /**
+     * pending timers do not fire any more
+     */
+    if (this->timer_thread) {
+        ATOMIC_STORE(&this->timer_stop, 1);
+        ATOMIC_ADD(&this->timer_seq, 1);
+        futex_wake(&this->timer_seq, 1);
+        this->timer_thread->join(this->timer_thread);
+        this->timer_thread = NULL;
+    }
+
+    /**
+     * wait until queues are empty and no job runs, the thread finishing
+     * last task wakes us up, no new job comes from out of pool from now on
+     */
+    if (mode == POOL_SHUTDOWN_DRAIN && pworkers && this->stats) {
+        while (1) {
+            seq = ATOMIC_LOAD(&this->park_seq);
+            if (pool_quiescent(this)) break;
+            futex_wait(&this->park_seq, seq);
+        }
+    }
+
+    /**
+     * destroy manager thread
+     */
+    if (thread_manager) {
+        ATOMIC_STORE(&this->thread_manager_stop, 1);
+        ATOMIC_STORE(&this->grow_pending, 1);
+        futex_wake(&this->grow_pending, 1);
+        thread_manager->join(thread_manager);
+    }
+
+    /**
+     * stop workers, no thread retires itself from now on
+     */
+    if (pthread_list_lock) {
+        pthread_list_lock->lock(pthread_list_lock);
+        ATOMIC_STORE(&this->stop, 1);
+        thread_cnt = pool_cur_size;
+        pthread_list_lock->unlock(pthread_list_lock);
+    }
+    pool_post(this, thread_cnt);
+
+    /**
+     * running jobs finish, queued ones are dropped
+     */
+    if (pworkers) {
+        for (i = 0; i < pool_max_size; i++) {
+            if (!pworkers[i]) continue;
+            pworkers[i]->thread->join(pworkers[i]->thread);
+            free(pworkers[i]);
+            pworkers[i] = NULL;
+        }
+    }
+    if (ptask_queue->cells && this->prio_lock) pool_drop_queued(this);
+
+    return 0;
+}
+
+METHOD(pool_t, destroy_, void, private_pool_t *this)
+{
+    int i = 0;
+    thread_task_t *task  = NULL;
+    private_future_t *future = NULL;
+    strand_t *strand = NULL;
+    strand_job_t *job = NULL;
+    private_timer_t *timer = NULL;
+
+    if (this == ATOMIC_LOAD(&default_pool) || pool_own_thread(this)) return;
+
+    /**
+     * stop and join threads if not shut down yet, pending jobs are dropped
+     */
+#ifndef _WIN32
+    _shutdown_(this, POOL_SHUTDOWN_DROP);
+#else
+    shutdown_(this, POOL_SHUTDOWN_DROP);
+#endif
+    if (pworkers) free(pworkers);
+
+    /**
+     * free task
+     */
+    if (pdeques) {
+        for (i = 0; i < pool_max_size; i++) {
+            if (!pdeques[i]) continue;
+            while ((task = deque_pop(pdeques[i])) != NULL) task_rec_free(task);
+            free(pdeques[i]);
+        }
+        free(pdeques);
+    }
+    if (ptask_queue->cells) free(ptask_queue->cells);
+
+    /**
+     * free lock
+     */
+    while (this->future_free) {
+        future = this->future_free;
+        this->future_free = future->next;
+        free(future);
+    }
+    if (this->future_lock) this->future_lock->destroy(this->future_lock);
+    if (this->cpus) free(this->cpus);
+    if (this->stats) free(this->stats);
+    if (this->strands) {
+        for (i = 0; i < DFT_STRAND_BUCKETS; i++) {
+            while ((strand = this->strands[i].strands) != NULL) {
+                this->strands[i].strands = strand->next;
+                while ((job = strand->head) != NULL) {
+                    strand->head = job->next;
+                    task_rec_free(job);
+                }
+                free(strand);
+            }
+            if (this->strands[i].lock) this->strands[i].lock->destroy(this->strands[i].lock);
+        }
+        free(this->strands);
+    }
+    if (this->wheel) {
+        for (i = 0; i < TIMER_LEVELS * TIMER_SLOTS; i++) {
+            while ((timer = this->wheel->slots[i / TIMER_SLOTS][i % TIMER_SLOTS]) != NULL) {
+                this->wheel->slots[i / TIMER_SLOTS][i % TIMER_SLOTS] = timer->next;
+                timer_unref(timer);
+            }
+        }
+        free(this->wheel);
+    }
+    if (this->timer_lock) this->timer_lock->destroy(this->timer_lock);
+    if (this->prio_heap) free(this->prio_heap);
+    if (this->prio_lock) this->prio_lock->destroy(this->prio_lock);
+    if (pthread_list_lock) pthread_list_lock->destroy(pthread_list_lock);
+    free(this);
+}
+
+/**
+ * @brief thread manager handler, sleeps until pool_grow asks for threads
+ */
+static void thread_manager_handler(private_pool_t *this)
+{
+    int i = 0, cnt = 0, started = 0, seen = 0;
+
+    while (1) {
+        while (!ATOMIC_LOAD(&this->grow_pending)) {
+            futex_wait(&this->grow_pending, 0);
+        }
+        if (ATOMIC_LOAD(&this->thread_manager_stop)) break;
+
+        /**
+         * one thread per grow_depth queued tasks, at least one, then
+         * look at queue again once they run, until queued tasks are
+         * within grow_depth
+         */
+        do {
+            cnt = pool_queued(this) / this->grow_depth;
+            if (cnt > pool_max_size - ATOMIC_LOAD(&pool_cur_size)) {
+                cnt = pool_max_size - ATOMIC_LOAD(&pool_cur_size);
+            }
+            if (cnt < 1) cnt = 1;
+
+            started = ATOMIC_LOAD(&this->started);
+            for (i = 0; i < cnt; i++) {
+                if (thread_pkg_init(this) != 0) break;
+            }
+
+            /**
+             * queue looks as deep as before until added threads run
+             */
+            while ((seen = ATOMIC_LOAD(&this->started)) - started < i) {
+                futex_wait(&this->started, seen);
+            }
+        } while (i == cnt && !ATOMIC_LOAD(&this->thread_manager_stop) &&
+                 pool_queued(this) > this->grow_depth);
+
+        ATOMIC_STORE(&this->grow_pending, 0);
+    }
+}
+
+/**
+ * @brief count of online cpus
+ */
+static int online_cpus()
+{
+#ifndef _WIN32
+    long cnt = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cnt > 0 ? (int)cnt : 1;
+#else
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#endif
+}
+
+/**
+ * @brief cpus of worker slots, from attr or all cpus process may run on
+ *
+ * @return 0 if succ, -1 if failed
+ */
+static int init_cpus(private_pool_t *this, pool_attr_t *attr)
+{
+#ifndef _WIN32
+    cpu_set_t set;
+#else
+    DWORD_PTR mask = 0, sys_mask = 0;
+#endif
+    int i = 0;
+
+    if (attr->cpus && attr->cpu_count > 0) {
+        this->cpus = malloc(attr->cpu_count * sizeof(int));
+        if (!this->cpus) return -1;
+        memcpy(this->cpus, attr->cpus, attr->cpu_count * sizeof(int));
+        this->cpu_count = attr->cpu_count;
+        return 0;
+    }
+    if (!(attr->flags & POOL_CPU_AFFINITY)) return 0;
+
+#ifndef _WIN32
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    this->cpus = malloc(CPU_COUNT(&set) * sizeof(int));
+    if (!this->cpus) return -1;
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) this->cpus[this->cpu_count++] = i;
+    }
+#else
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &sys_mask)) return -1;
+    this->cpus = malloc(sizeof(mask) * 8 * sizeof(int));
+    if (!this->cpus) return -1;
+    for (i = 0; i < (int)sizeof(mask) * 8; i++) {
+        if (mask & ((DWORD_PTR)1 << i)) this->cpus[this->cpu_count++] = i;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief init thread pool
+ */
+static int init_pool(private_pool_t *this)
+{
+    int i = 0;
+
+    /**
+     * create worker slots and deques
+     */
+    if (pool_max_size < pool_min_size) pool_max_size = pool_min_size;
+    if (pool_max_size <= 0) return -1;
+    pworkers = calloc(pool_max_size, sizeof(thread_pkg_t *));
+    if (!pworkers) return -1;
+    this->stats = calloc(pool_max_size, sizeof(worker_stats_t));
+    if (!this->stats) return -1;
+
+    /**
+     * spinning only pays off if producers run on another cpu
+     */
+    if (online_cpus() <= 1) this->spin_max = 0;
+    for (i = 0; i < pool_max_size; i++) this->stats[i].spin_budget = this->spin_max;
+    if (task_ring_init(ptask_queue, this->queue_size) != 0) return -1;
+    if (this->flags & POOL_WORK_STEALING) {
+        pdeques = calloc(pool_max_size, sizeof(task_deque_t *));
+        if (!pdeques) return -1;
+    }
+    this->strands = calloc(DFT_STRAND_BUCKETS, sizeof(strand_bucket_t));
+    if (!this->strands) return -1;
+    for (i = 0; i < DFT_STRAND_BUCKETS; i++) {
+        this->strands[i].lock = mutex_create();
+        if (!this->strands[i].lock) return -1;
+    }
+
+    /**
+     * create thread in pool
+     */
+    for (i = 0; i < pool_min_size; i++) {
+        if (thread_pkg_init(this) < 0) break;
+    }
+    if (i < pool_min_size) return -1;
+
+    /**
+     * create manager thread, only needed if pool can grow
+     */
+    this->enable_thread_manager = pool_max_size > pool_min_size;
+    if (this->enable_thread_manager) {
+        thread_manager = thread_create((void *)thread_manager_handler, this);
+        if (!thread_manager) return -1;
+    }
+
+    return 0;
+}
+
+static void strand_run(strand_t *this);
+static void range_task(range_node_t *this);
+
+/**
+ * @brief push task to ring, or to priority heap if key given
+ */
+static int pool_queue_push(private_pool_t *this, thread_task_t *task, long long *key)
+{
+    if (key) return prio_push(this, task, *key);
+    return task_ring_push(ptask_queue, task);
+}
+
+/**
+ * @brief take oldest job out of ring to make room, jobs pool added for
+ *        strands, timers, futures and ranges have waiters or followers,
+ *        they run in caller instead of being lost, a dropped group job
+ *        counts as cancelled
+ *
+ * @return 0 if a slot was freed, -1 if ring is empty
+ */
+static int pool_drop_oldest(private_pool_t *this)
+{
+    thread_task_t task = {0};
+
+    if (task_ring_pop(ptask_queue, &task) != 0) return -1;
+
+    if (task.work == (void *)strand_run || task.work == (void *)timer_run ||
+        task.work == (void *)future_run || task.work == (void *)range_task) {
+        pool_run_task(this, &task);
+        return 0;
+    }
+    if (task.work == (void *)group_run) group_drop(task.arg);
+    ATOMIC_ADD(&this->dropped, 1);
+
+    return 0;
+}
+
+/**
+ * @brief handle task that did not fit in full queue by policy
+ *
+ * @param key     priority key if task goes to heap, NULL for ring
+ * @param policy  pool_overflow_t
+ * @return        0 if queued, 1 if run in caller, -1 if failed
+ */
+static int pool_overflow(private_pool_t *this, thread_task_t *task, long long *key, int policy)
+{
+    int seq = 0, ret = -1;
+
+    /**
+     * a worker waiting for room in its own pool may wait for ever
+     */
+    if (policy == POOL_OVERFLOW_BLOCK && current_worker && current_worker->pool == this) {
+        policy = POOL_OVERFLOW_CALLER_RUNS;
+    }
+
+    switch (policy) {
+    case POOL_OVERFLOW_BLOCK:
+        /**
+         * count ourselves before retrying, so a worker taking a task
+         * after the retry failed sees us and bumps space_seq
+         */
+        ATOMIC_ADD(&this->space_waiters, 1);
+        while (1) {
+            seq = ATOMIC_LOAD(&this->space_seq);
+            if (!pool_accepting(this)) break;
+            if (pool_queue_push(this, task, key) == 0) {
+                ret = 0;
+                break;
+            }
+            futex_wait(&this->space_seq, seq);
+        }
+        ATOMIC_SUB(&this->space_waiters, 1);
+        return ret;
+
+    case POOL_OVERFLOW_CALLER_RUNS:
+        task->work(task->arg);
+        ATOMIC_ADD(&this->caller_ran, 1);
+        return 1;
+
+    case POOL_OVERFLOW_DROP_OLDEST:
+        /**
+         * heap is ordered by due time, not age, nothing to drop there
+         */
+        if (key) return -1;
+        while (pool_queue_push(this, task, key) != 0) {
+            if (pool_drop_oldest(this) != 0) sched_yield();
+        }
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief add job to worker's own deque or pool task queue
+ *
+ * @param policy  pool_overflow_t applied when queue is full, pool itself
+ *                adds with POOL_OVERFLOW_FAIL and handles failure
+ * @return        0 if succ, -1 if failed
+ */
+static int pool_addjob(private_pool_t *this, void (*job) (void *), void *arg, int policy)
+{
+    thread_task_t task  = {0};
+    thread_task_t *ltask = NULL;
+    int ret = 0;
+
+    if (!ptask_queue->cells || !pool_accepting(this)) return -1;
+
+    task.work  = job;
+    task.arg   = arg;
+    task.stamp = monotonic_ns();
+
+    /**
+     * job added by a job of this pool goes to the worker's own deque,
+     * take it back to pool task queue when deque is full
+     */
+    if (pdeques && current_worker && current_worker->pool == this && pdeques[current_worker->index]) {
+        ltask = create_thread_task(job, arg);
+        if (!ltask) return -1;
+        STATS_ADD(this->stats[current_worker->index].pushed, 1);
+        if (deque_push(pdeques[current_worker->index], ltask) == 0) {
+            pool_wakeup(this, 1);
+            return 0;
+        }
+        STATS_ADD(this->stats[current_worker->index].pushed, -1);
+        task_rec_free(ltask);
+    }
+
+    /**
+     * copy task into pool task queue, one parked worker pulls it,
+     * a full queue pushes back on caller by policy
+     */
+    if (task_ring_push(ptask_queue, &task) != 0) {
+        ret = pool_overflow(this, &task, NULL, policy);
+        if (ret < 0) return -1;
+        if (ret > 0) return 0;
+    }
+    pool_wakeup(this, 1);
+
+    return 0;
+}
+
+METHOD(pool_t, addjob_, int, private_pool_t *this, void (*job) (void *), void *arg)
+{
+    return pool_addjob(this, job, arg, this->overflow);
+}
+
+METHOD(pool_t, addjobs_, int, private_pool_t *this, void (*job[]) (void *), void *arg[], int n)
+{
+    thread_task_t task  = {0};
+    thread_task_t *ltask = NULL;
+    int added = 0, cnt = 0, ret = 0;
+
+    if (!ptask_queue->cells || !job || n <= 0 || !pool_accepting(this)) return -1;
+
+    /**
+     * jobs added by a job of this pool go to the worker's own deque
+     */
+    if (pdeques && current_worker && current_worker->pool == this && pdeques[current_worker->index]) {
+        for (; added < n; added++) {
+            ltask = create_thread_task(job[added], arg ? arg[added] : NULL);
+            if (!ltask) break;
+            STATS_ADD(this->stats[current_worker->index].pushed, 1);
+            if (deque_push(pdeques[current_worker->index], ltask) != 0) {
+                STATS_ADD(this->stats[current_worker->index].pushed, -1);
+                task_rec_free(ltask);
+                break;
+            }
+        }
+    }
+
+    /**
+     * rest of batch goes to pool task queue, usually in one reservation
+     */
+    while (added < n) {
+        cnt = task_ring_push_n(ptask_queue, job + added, arg ? arg + added : NULL, n - added);
+        if (cnt <= 0) break;
+        added += cnt;
+    }
+
+    pool_wakeup(this, added);
+
+    /**
+     * queue is full, rest of batch goes one by one by policy, workers
+     * are already woken up for the part queued
+     */
+    for (; added < n && this->overflow != POOL_OVERFLOW_FAIL; added++) {
+        task.work  = job[added];
+        task.arg   = arg ? arg[added] : NULL;
+        task.stamp = monotonic_ns();
+        ret = pool_overflow(this, &task, NULL, this->overflow);
+        if (ret < 0) break;
+        if (ret == 0) pool_wakeup(this, 1);
+    }
+
+    return added;
+}
+
+/**
+ * @brief bucket of strand table for key
+ */
+static strand_bucket_t *strand_bucket(private_pool_t *this, unsigned long key)
+{
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+
+    return &this->strands[key & (DFT_STRAND_BUCKETS - 1)];
+}
 
 /**
- * @brief thread manager handler 
+ * @brief task handler of strand, runs its jobs one by one until it is
+ *        empty, gives worker back to other tasks every DFT_STRAND_BATCH
+ *        jobs
  */
-static void task_manager_handler(private_pool_t *this)
+static void strand_run(strand_t *this)
 {
-    thread_pkg_t *thread = NULL;
+    private_pool_t *pool = this->pool;
+    strand_bucket_t *bucket = strand_bucket(pool, this->key);
+    strand_t **pos = NULL;
+    strand_job_t *job = NULL;
+    int cnt = 0;
+
+    while (1) {
+        /**
+         * keep running the strand when queue is full, and try again
+         * after next batch
+         */
+        if (cnt == DFT_STRAND_BATCH) {
+            cnt = 0;
+            if (pool_addjob(pool, (void *)strand_run, this, POOL_OVERFLOW_FAIL) == 0) return;
+        }
+
+        bucket->lock->lock(bucket->lock);
+        job = this->head;
+        if (!job) {
+            /**
+             * drained, next job of key creates a new strand
+             */
+            for (pos = &bucket->strands; *pos != this; pos = &(*pos)->next);
+            *pos = this->next;
+            bucket->lock->unlock(bucket->lock);
+            free(this);
+            return;
+        }
+        this->head = job->next;
+        if (!this->head) this->tail = NULL;
+        bucket->lock->unlock(bucket->lock);
+
+        job->work(job->arg);
+        task_rec_free(job);
+        cnt++;
+    }
+}
+
+METHOD(pool_t, addjob_keyed_, int, private_pool_t *this, unsigned long key,
+       void (*job) (void *), void *arg)
+{
+    strand_bucket_t *bucket = NULL;
+    strand_t *strand = NULL;
+    strand_job_t *sjob = NULL;
+
+    if (!job || !this->strands || !pool_accepting(this)) return -1;
+
+    sjob = task_rec_alloc();
+    if (!sjob) return -1;
+    sjob->work = job;
+    sjob->arg  = arg;
+    sjob->next = NULL;
+
+    /**
+     * a busy key only queues job behind the others, its strand task
+     * picks it up, no worker blocks on the key
+     */
+    bucket = strand_bucket(this, key);
+    bucket->lock->lock(bucket->lock);
+    for (strand = bucket->strands; strand; strand = strand->next) {
+        if (strand->key == key) break;
+    }
+    if (strand) {
+        if (strand->tail) strand->tail->next = sjob;
+        else strand->head = sjob;
+        strand->tail = sjob;
+        bucket->lock->unlock(bucket->lock);
+        return 0;
+    }
+
+    strand = malloc(sizeof(strand_t));
+    if (!strand) {
+        bucket->lock->unlock(bucket->lock);
+        task_rec_free(sjob);
+        return -1;
+    }
+    strand->key  = key;
+    strand->pool = this;
+    strand->head = sjob;
+    strand->tail = sjob;
+    strand->next = bucket->strands;
+    bucket->strands = strand;
+    bucket->lock->unlock(bucket->lock);
+
+    /**
+     * strand is already visible, run it in caller if task queue full
+     */
+    if (pool_addjob(this, (void *)strand_run, strand, POOL_OVERFLOW_FAIL) != 0) strand_run(strand);
+
+    return 0;
+}
+
+/**
+ * @brief put timer in slot of wheel by its expiry, timer_lock held
+ */
+static void timer_link(timer_wheel_t *this, private_timer_t *timer)
+{
+    unsigned long long delta = 0;
+    private_timer_t **slot = NULL;
+    int level = 0;
+
+    if (timer->expires < this->tick) timer->expires = this->tick;
+    delta = timer->expires - this->tick;
+    while (level < TIMER_LEVELS - 1 && delta >> (TIMER_SLOT_BITS * (level + 1))) level++;
+    if (delta >> (TIMER_SLOT_BITS * TIMER_LEVELS)) {
+        timer->expires = this->tick + (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1;
+    }
+
+    slot = &this->slots[level][(timer->expires >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK];
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) (*slot)->prev = timer;
+    *slot = timer;
+    timer->state = TIMER_PENDING;
+    this->count++;
+}
+
+/**
+ * @brief take timer out of its slot, timer_lock held
+ */
+static void timer_unlink(timer_wheel_t *this, private_timer_t *timer)
+{
+    if (timer->prev) timer->prev->next = timer->next;
+    else *timer->slot = timer->next;
+    if (timer->next) timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+    this->count--;
+}
+
+/**
+ * @brief give handle or wheel reference back, free at last
+ */
+static void timer_unref(private_timer_t *this)
+{
+    if (ATOMIC_SUB(&this->refs, 1) > 0) return;
+    free(this);
+}
+
+/**
+ * @brief expire ticks up to now, expired timers are chained on next
+ *
+ * @return expired timers, timer_lock held
+ */
+static private_timer_t *timer_expire(timer_wheel_t *this, unsigned long long now)
+{
+    private_timer_t *expired = NULL, *timer = NULL, *next = NULL;
+    int level = 0, index = 0;
+
+    if (this->count == 0 && this->tick <= now) this->tick = now + 1;
 
-    while (!this->task_manager_stop) {   
+    while (this->tick <= now) {
         /**
-         * waiting for jobs and idle thread
+         * slot of level above turns into level 0 ticks, cascade it
          */
-        pool_has_work->wait(pool_has_work);
-        has_idle_pthread->wait(has_idle_pthread);
-        if (this->task_manager_stop) break;
+        for (level = 1; level < TIMER_LEVELS; level++) {
+            if (this->tick & ((1ULL << (TIMER_SLOT_BITS * level)) - 1)) break;
+            index = (this->tick >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK;
+            timer = this->slots[level][index];
+            this->slots[level][index] = NULL;
+            for (; timer; timer = next) {
+                next = timer->next;
+                this->count--;
+                timer_link(this, timer);
+            }
+        }
+
+        index = this->tick & TIMER_SLOT_MASK;
+        timer = this->slots[0][index];
+        this->slots[0][index] = NULL;
+        for (; timer; timer = next) {
+            next = timer->next;
+            this->count--;
+            timer->state = TIMER_QUEUED;
+            timer->prev = NULL;
+            timer->next = expired;
+            expired = timer;
+        }
+        this->tick++;
+    }
+
+    return expired;
+}
+
+/**
+ * @brief task handler of timer, puts periodic timer back in wheel
+ */
+static void timer_run(private_timer_t *this)
+{
+    private_pool_t *pool = this->pool;
+
+    pool->timer_lock->lock(pool->timer_lock);
+    if (this->state != TIMER_QUEUED) {
+        pool->timer_lock->unlock(pool->timer_lock);
+        timer_unref(this);
+        return;
+    }
+    this->state = TIMER_RUNNING;
+    pool->timer_lock->unlock(pool->timer_lock);
+
+    this->job(this->arg);
 
+    pool->timer_lock->lock(pool->timer_lock);
+    if (this->state == TIMER_RUNNING && this->period > 0) {
         /**
-         * find idle task
+         * fixed rate, a late run does not shift the next ones
          */
+        this->expires += this->period;
+        timer_link(pool->wheel, this);
+        if (this->expires < pool->wheel->wake) {
+            ATOMIC_ADD(&pool->timer_seq, 1);
+            futex_wake(&pool->timer_seq, 1);
+        }
+        pool->timer_lock->unlock(pool->timer_lock);
+        return;
+    }
+    if (this->state == TIMER_RUNNING) this->state = TIMER_DONE;
+    pool->timer_lock->unlock(pool->timer_lock);
+    timer_unref(this);
+}
+
+/**
+ * @brief timer thread, sleeps until next expiry and hands expired
+ *        timers to pool
+ */
+static void timer_handler(private_pool_t *this)
+{
+    timer_wheel_t *wheel = this->wheel;
+    private_timer_t *expired = NULL, *next = NULL;
+    unsigned long long now = 0;
+    int seq = 0, i = 0;
+
+    current_timer_pool = this;
+    while (!ATOMIC_LOAD(&this->timer_stop)) {
+        now = monotonic_ms();
+
+        this->timer_lock->lock(this->timer_lock);
+        expired = timer_expire(wheel, now);
 
         /**
-         * get one thread, if working, then continue util find idle
+         * sleep until next busy level 0 slot, or until next cascade
          */
-        thread = NULL;
-        pthread_list_lock->lock(pthread_list_lock);
-        pidle_thread_list->top(pidle_thread_list, (void **)&thread);
-        pthread_list_lock->unlock(pthread_list_lock);
-        if (!thread) continue;
+        wheel->wake = ULLONG_MAX;
+        if (wheel->count > 0) {
+            wheel->wake = (wheel->tick | TIMER_SLOT_MASK) + 1;
+            for (i = 0; i < TIMER_SLOTS - (int)(wheel->tick & TIMER_SLOT_MASK); i++) {
+                if (wheel->slots[0][(wheel->tick + i) & TIMER_SLOT_MASK]) {
+                    wheel->wake = wheel->tick + i;
+                    break;
+                }
+            }
+        }
+        seq = ATOMIC_LOAD(&this->timer_seq);
+        this->timer_lock->unlock(this->timer_lock);
+
+        for (; expired; expired = next) {
+            next = expired->next;
+            expired->next = NULL;
+            if (pool_addjob(this, (void *)timer_run, expired, POOL_OVERFLOW_FAIL) != 0) {
+                if (ATOMIC_LOAD(&this->closed)) timer_unref(expired);
+                else timer_run(expired);
+            }
+        }
+
+        now = monotonic_ms();
+        if (wheel->wake == ULLONG_MAX) futex_wait(&this->timer_seq, seq);
+        else if (wheel->wake > now) futex_timed_wait(&this->timer_seq, seq, (unsigned int)(wheel->wake - now));
+    }
+}
+
+METHOD(pool_timer_t, timer_cancel_, int, private_timer_t *this)
+{
+    private_pool_t *pool = this->pool;
+    int ret = -1, unref = 0;
+
+    pool->timer_lock->lock(pool->timer_lock);
+    switch (this->state) {
+        case TIMER_PENDING:
+            timer_unlink(pool->wheel, this);
+            unref = 1;
+            ret   = 0;
+            break;
+        case TIMER_QUEUED:
+            ret = 0;
+            break;
+        case TIMER_RUNNING:
+            ret = this->period > 0 ? 0 : -1;
+            break;
+        default:
+            pool->timer_lock->unlock(pool->timer_lock);
+            return -1;
+    }
+    this->state = TIMER_CANCELLED;
+    pool->timer_lock->unlock(pool->timer_lock);
+
+    if (unref) timer_unref(this);
+    return ret;
+}
+
+METHOD(pool_timer_t, timer_destroy_, void, private_timer_t *this)
+{
+    timer_unref(this);
+}
+
+/**
+ * @brief add timer to wheel, start timer thread first time
+ */
+static pool_timer_t *timer_add(private_pool_t *this, unsigned int delay, unsigned int period,
+                               void (*job) (void *), void *arg)
+{
+    private_timer_t *timer = NULL;
+
+    if (!job || !this->timer_lock || !pool_accepting(this)) return NULL;
+
+#ifndef _WIN32
+    INIT(timer,
+        .public = {
+            .cancel  = _timer_cancel_,
+            .destroy = _timer_destroy_,
+        },
+        .pool    = this,
+        .job     = job,
+        .arg     = arg,
+        .expires = monotonic_ms() + delay,
+        .period  = period,
+        .state   = TIMER_PENDING,
+        .refs    = 2,
+    );
+#else
+    INIT(timer, private_timer_t,
+        {
+            timer_cancel_,
+            timer_destroy_,
+        },
+        this,
+        job,
+        arg,
+        monotonic_ms() + delay,
+        period,
+        TIMER_PENDING,
+        2,
+        NULL,
+        NULL,
+        NULL,
+    );
+#endif
+    if (!timer) return NULL;
+
+    this->timer_lock->lock(this->timer_lock);
+    if (!this->wheel) {
+        this->wheel = calloc(1, sizeof(timer_wheel_t));
+        if (this->wheel) {
+            this->wheel->tick = monotonic_ms();
+            this->wheel->wake = ULLONG_MAX;
+            this->timer_thread = thread_create((void *)timer_handler, this);
+        }
+        if (!this->timer_thread) {
+            free(this->wheel);
+            this->wheel = NULL;
+        }
+    }
+    if (!this->wheel || ATOMIC_LOAD(&this->timer_stop)) {
+        this->timer_lock->unlock(this->timer_lock);
+        free(timer);
+        return NULL;
+    }
+
+    timer_link(this->wheel, timer);
+    if (timer->expires < this->wheel->wake) {
+        ATOMIC_ADD(&this->timer_seq, 1);
+        futex_wake(&this->timer_seq, 1);
+    }
+    this->timer_lock->unlock(this->timer_lock);
+
+    return &timer->public;
+}
+
+METHOD(pool_t, addjob_after_, pool_timer_t *, private_pool_t *this, unsigned int delay,
+       void (*job) (void *), void *arg)
+{
+    return timer_add(this, delay, 0, job, arg);
+}
+
+METHOD(pool_t, addjob_every_, pool_timer_t *, private_pool_t *this, unsigned int period,
+       void (*job) (void *), void *arg)
+{
+    if (period == 0) return NULL;
+    return timer_add(this, period, period, job, arg);
+}
+
+METHOD(pool_t, addjob_prio_, int, private_pool_t *this, int prio, unsigned int deadline,
+       void (*job) (void *), void *arg)
+{
+    thread_task_t task = {0};
+    long long key = 0;
+    int ret = 0;
+
+    if (!job || prio < 0 || !pool_accepting(this)) return -1;
+
+    task.work  = job;
+    task.arg   = arg;
+    task.stamp = monotonic_ns();
+
+    /**
+     * each level below high is worth prio_aging of waiting, so a long
+     * waiting low task gets ahead of new high ones, deadline caps it
+     */
+    key = task.stamp + prio * this->prio_aging;
+    if (deadline > 0 && task.stamp + (long long)deadline * 1000000 < key) {
+        key = task.stamp + (long long)deadline * 1000000;
+    }
+
+    if (prio_push(this, &task, key) != 0) {
+        ret = pool_overflow(this, &task, &key, this->overflow);
+        if (ret < 0) return -1;
+        if (ret > 0) return 0;
+    }
+    pool_wakeup(this, 1);
+
+    return 0;
+}
+
+/**
+ * @brief give handle or pool reference back, free to pool at last
+ */
+static void future_unref(private_future_t *this)
+{
+    private_pool_t *pool = this->pool;
+
+    if (ATOMIC_SUB(&this->refs, 1) > 0) return;
+
+    pool->future_lock->lock(pool->future_lock);
+    this->next = pool->future_free;
+    pool->future_free = this;
+    pool->future_lock->unlock(pool->future_lock);
+}
+
+/**
+ * @brief run job of future on pool, or in caller if task queue full
+ */
+static void future_schedule(private_future_t *this)
+{
+    if (pool_addjob(this->pool, (void *)future_run, this, POOL_OVERFLOW_FAIL) != 0) {
+        future_run(this);
+    }
+}
+
+/**
+ * @brief publish result, wake up waiters and start continuations
+ */
+static void future_complete(private_future_t *this, void *result)
+{
+    private_future_t *conts = NULL, *next = NULL, *prev = NULL;
+
+    this->result = result;
+    conts = (private_future_t *)ATOMIC_XCHG(&this->conts, FUTURE_DONE);
+    ATOMIC_STORE(&this->state, 1);
+    ATOMIC_FENCE();
+    if (ATOMIC_LOAD(&this->waiters) > 0) futex_wake(&this->state, INT_MAX);
+
+    /**
+     * continuations are pushed at head, start them in order of then()
+     */
+    while (conts) {
+        next = conts->next;
+        conts->next = prev;
+        prev = conts;
+        conts = next;
+    }
+    while (prev) {
+        next = prev->next;
+        prev->prev_result = result;
+        future_schedule(prev);
+        prev = next;
+    }
+
+    future_unref(this);
+}
+
+/**
+ * @brief task handler of future job
+ */
+static void future_run(private_future_t *this)
+{
+    void *result = NULL;
+
+    if (this->cont) result = this->cont(this->arg, this->prev_result);
+    else if (this->job) result = this->job(this->arg);
+    future_complete(this, result);
+}
+
+/**
+ * @brief job of future dropped by stopped pool, it never finishes, nor
+ *        do its continuations, give their pool references back
+ */
+static void future_drop(private_future_t *this)
+{
+    private_future_t *conts = NULL, *next = NULL;
+
+    conts = (private_future_t *)ATOMIC_XCHG(&this->conts, FUTURE_DROPPED);
+    for (; conts; conts = next) {
+        next = conts->next;
+        future_drop(conts);
+    }
+    future_unref(this);
+}
+
+METHOD(future_t, future_is_done_, int, private_future_t *this)
+{
+    return ATOMIC_LOAD(&this->state);
+}
+
+METHOD(future_t, future_timed_wait_, int, private_future_t *this, unsigned int timeout, void **result)
+{
+    long long deadline = monotonic_ms() + timeout;
+    long long left     = timeout;
+
+    while (!ATOMIC_LOAD(&this->state)) {
+        if (left <= 0) return -1;
+        ATOMIC_ADD(&this->waiters, 1);
+        futex_timed_wait(&this->state, 0, (unsigned int)left);
+        ATOMIC_SUB(&this->waiters, 1);
+        left = deadline - monotonic_ms();
+    }
+
+    if (result) *result = this->result;
+    return 0;
+}
+
+METHOD(future_t, future_wait_, void *, private_future_t *this)
+{
+    while (!ATOMIC_LOAD(&this->state)) {
+        ATOMIC_ADD(&this->waiters, 1);
+        futex_wait(&this->state, 0);
+        ATOMIC_SUB(&this->waiters, 1);
+    }
+
+    return this->result;
+}
+
+/**
+ * @brief take a future from pool free list, malloc only if empty
+ */
+static private_future_t *future_alloc(private_pool_t *pool);
+
+METHOD(future_t, future_then_, future_t *, private_future_t *this, void *(*job) (void *arg, void *result), void *arg)
+{
+    private_future_t *cont = NULL;
+    private_future_t *head = NULL;
+
+    if (!job) return NULL;
+    cont = future_alloc(this->pool);
+    if (!cont) return NULL;
+    cont->cont = job;
+    cont->arg  = arg;
+
+    /**
+     * hook on this future, or start at once if already done, a dropped
+     * future never finishes, so is its continuation
+     */
+    head = ATOMIC_LOAD(&this->conts);
+    do {
+        if (head == FUTURE_DONE) {
+            cont->prev_result = this->result;
+            future_schedule(cont);
+            break;
+        }
+        if (head == FUTURE_DROPPED) {
+            future_drop(cont);
+            break;
+        }
+        cont->next = head;
+    } while (!ATOMIC_CAS(&this->conts, &head, cont));
+
+    return &cont->public;
+}
+
+METHOD(future_t, future_destroy_, void, private_future_t *this)
+{
+    future_unref(this);
+}
+
+static private_future_t *future_alloc(private_pool_t *pool)
+{
+    private_future_t *this = NULL;
+
+    pool->future_lock->lock(pool->future_lock);
+    this = pool->future_free;
+    if (this) pool->future_free = this->next;
+    pool->future_lock->unlock(pool->future_lock);
+
+    if (!this) {
+#ifndef _WIN32
+        INIT(this,
+            .public = {
+                .wait       = _future_wait_,
+                .timed_wait = _future_timed_wait_,
+                .is_done    = _future_is_done_,
+                .then       = _future_then_,
+                .destroy    = _future_destroy_,
+            },
+        );
+#else
+        INIT(this, private_future_t,
+            {
+                future_wait_,
+                future_timed_wait_,
+                future_is_done_,
+                future_then_,
+                future_destroy_,
+            },
+        );
+#endif
+        if (!this) return NULL;
+    }
+
+    this->pool        = pool;
+    this->state       = 0;
+    this->waiters     = 0;
+    this->refs        = 2;
+    this->job         = NULL;
+    this->cont        = NULL;
+    this->arg         = NULL;
+    this->prev_result = NULL;
+    this->result      = NULL;
+    this->conts       = NULL;
+    this->next        = NULL;
+
+    return this;
+}
+
+METHOD(pool_t, addjob_future_, future_t *, private_pool_t *this, void *(*job) (void *), void *arg)
+{
+    private_future_t *future = NULL;
+
+    if (!job || !pool_accepting(this)) return NULL;
+    future = future_alloc(this);
+    if (!future) return NULL;
+    future->job = job;
+    future->arg = arg;
+
+    if (addjob_(this, (void *)future_run, future) != 0) {
+        future->refs = 1;
+        future_unref(future);
+        return NULL;
+    }
+
+    return &future->public;
+}
+
+/**
+ * @brief give handle or job reference back, free group at last
+ */
+static void group_unref(private_group_t *this)
+{
+    if (ATOMIC_SUB(&this->refs, 1) > 0) return;
+
+    this->lock->destroy(this->lock);
+    free(this);
+}
+
+/**
+ * @brief count cnt jobs of group as finished, wake up waiters at last
+ */
+static void group_finish(private_group_t *this, int cnt)
+{
+    if (cnt <= 0) return;
+    if (ATOMIC_SUB(&this->active, cnt) == 0 && ATOMIC_LOAD(&this->waiters) > 0) {
+        futex_wake(&this->active, INT_MAX);
+    }
+}
+
+/**
+ * @brief take job out of queued jobs of its group, group lock held
+ *
+ * @return task func, NULL if job was cancelled before
+ */
+static void (*group_take(group_job_t *this)) (void *)
+{
+    void (*work) (void *) = this->work;
+
+    if (!work) return NULL;
+    if (this->prev) this->prev->next = this->next;
+    else this->group->queued = this->next;
+    if (this->next) this->next->prev = this->prev;
+    this->work = NULL;
+
+    return work;
+}
 
-        /**
-         * get one job, let thread execute
-         */
-        task_lock->lock(task_lock);
-        ptask_list->top(ptask_list, (void **)&thread->task);
-        task_lock->unlock(task_lock);
+/**
+ * @brief task handler of group job, runs job unless cancelled
+ */
+static void group_run(group_job_t *this)
+{
+    private_group_t *group = this->group;
+    void (*work) (void *) = NULL;
 
-        pthread_list_lock->lock(pthread_list_lock);
-        pbusy_thread_list->insert_last(pbusy_thread_list, thread);
-        pthread_list_lock->unlock(pthread_list_lock);
-        thread->wait_job->post(thread->wait_job);
+    group->lock->lock(group->lock);
+    work = group_take(this);
+    group->lock->unlock(group->lock);
+
+    if (work) {
+        work(this->arg);
+        group_finish(group, 1);
     }
+    task_rec_free(this);
+    group_unref(group);
 }
 
 /**
- * @brief thread manager handler 
+ * @brief drop queued group job without running it, counts as cancelled
  */
-static void thread_manager_handler(private_pool_t *this)
-{   
-    int found_idle_cnt = 0;
-    int thread_cnt     = 0;
-    int free_time      = DFT_IDLE_THREAD_FREE_TIME * TIME_PER_SEC;
-    int idle_stay_time = 0;
-    thread_pkg_t *thread        = NULL;
-    tclock_t cur_time           = {0};
-    struct   timeval wait_time  = {0};
-
-    while (!this->thread_manager_stop) {   
-        wait_time.tv_sec  = 0;
-        wait_time.tv_usec = 100000;
-#ifndef _WIN32
-        select(0, NULL, NULL, NULL, &wait_time);
-#else
-        USLEEP(1);
-#endif
-        if (this->thread_manager_stop) break;
+static void group_drop(group_job_t *this)
+{
+    private_group_t *group = this->group;
+    void (*work) (void *) = NULL;
 
-        /**
-         * create new thread to thread pool
-         */
-        if (ptask_list->get_count(ptask_list) > 1 && pool_cur_size < pool_max_size) {
-            thread_pkg_init(this);
-            continue;
-        }
+    group->lock->lock(group->lock);
+    work = group_take(this);
+    group->lock->unlock(group->lock);
 
-        /**
-         * move busy_thread to idle_thread
-         */
-        found_idle_cnt = 0;
+    if (work) group_finish(group, 1);
+    task_rec_free(this);
+    group_unref(group);
+}
 
-        pthread_list_lock->lock(pthread_list_lock);
-        pbusy_thread_list->reset_current(pbusy_thread_list);
-        thread_cnt = pbusy_thread_list->get_count(pbusy_thread_list);
-        pthread_list_lock->unlock(pthread_list_lock);
+METHOD(pool_group_t, group_addjob_, int, private_group_t *this, void (*job) (void *), void *arg)
+{
+    group_job_t *gjob = NULL;
+
+    if (!job || !pool_accepting(this->pool)) return -1;
+    gjob = task_rec_alloc();
+    if (!gjob) return -1;
+    gjob->work  = job;
+    gjob->arg   = arg;
+    gjob->group = this;
+    gjob->prev  = NULL;
+
+    ATOMIC_ADD(&this->refs, 1);
+    ATOMIC_ADD(&this->active, 1);
+    this->lock->lock(this->lock);
+    gjob->next = this->queued;
+    if (this->queued) this->queued->prev = gjob;
+    this->queued = gjob;
+    this->lock->unlock(this->lock);
 
-        while (thread_cnt-- > 0) {
-            thread = NULL;
-            pthread_list_lock->lock(pthread_list_lock);
-            pbusy_thread_list->top(pbusy_thread_list, (void **)&thread);
-            pthread_list_lock->unlock(pthread_list_lock);
-            if (!thread) break;
-
-            if (thread->state == THREAD_IDLE) {
-                pthread_list_lock->lock(pthread_list_lock);
-                pidle_thread_list->insert_last(pidle_thread_list, thread);
-                pthread_list_lock->unlock(pthread_list_lock);
-                found_idle_cnt++;
-            } else {
-                pthread_list_lock->lock(pthread_list_lock);
-                pbusy_thread_list->insert_last(pbusy_thread_list, thread);
-                pthread_list_lock->unlock(pthread_list_lock);
-            }
-            thread = NULL;
-        }
+    /**
+     * job record itself is the task, cancel only unlinks it, the task
+     * finds it cancelled when it is taken from queue
+     */
+    if (pool_addjob(this->pool, (void *)group_run, gjob, this->pool->overflow) != 0) {
+        group_drop(gjob);
+        return -1;
+    }
 
-        pthread_list_lock->lock(pthread_list_lock);
-        while (found_idle_cnt-- > 0) {
-            has_idle_pthread->post(has_idle_pthread);
-        }
-        pthread_list_lock->unlock(pthread_list_lock);
+    return 0;
+}
 
-        /**
-         * free idle thread
-         */
-        if (this->cur_size <= this->min_size) continue;
-        pidle_thread_list->reset_current(pidle_thread_list);
+METHOD(pool_group_t, group_cancel_, int, private_group_t *this)
+{
+    group_job_t *gjob = NULL;
+    int cnt = 0;
 
-        pthread_list_lock->lock(pthread_list_lock);
-        thread_cnt = pidle_thread_list->get_count(pidle_thread_list);
-        pthread_list_lock->unlock(pthread_list_lock);
-        while (thread_cnt-- > 0) {
-			thread = NULL;
-            pthread_list_lock->lock(pthread_list_lock);
-            pidle_thread_list->top(pidle_thread_list, (void **)&thread);
-            pthread_list_lock->unlock(pthread_list_lock);
-            if (!thread) break;
-
-            GETCURRTIME(cur_time);
-            idle_stay_time = (unsigned int)GETCOSTTIME(cur_time, (thread->idle_time)) * TIME_PER_SEC;
-            if (idle_stay_time < 0 || idle_stay_time < free_time) {
-                pthread_list_lock->lock(pthread_list_lock);
-                pidle_thread_list->insert_last(pidle_thread_list, thread);
-                pthread_list_lock->unlock(pthread_list_lock);
-                continue;
-            }
+    this->lock->lock(this->lock);
+    for (gjob = this->queued; gjob; gjob = gjob->next) {
+        gjob->work = NULL;
+        cnt++;
+    }
+    this->queued = NULL;
+    this->lock->unlock(this->lock);
 
-            /**
-             * free idle thread
-             */
-            thread_pkg_deinit(this, thread);
-            thread = NULL;
+    group_finish(this, cnt);
 
-            if (this->thread_manager_stop) {
-                break;
-            }
-        }
+    return cnt;
+}
+
+METHOD(pool_group_t, group_timed_wait_, int, private_group_t *this, unsigned int timeout)
+{
+    long long deadline = monotonic_ms() + timeout;
+    long long left     = timeout;
+    int active = 0;
+
+    while ((active = ATOMIC_LOAD(&this->active)) != 0) {
+        if (left <= 0) return -1;
+        ATOMIC_ADD(&this->waiters, 1);
+        futex_timed_wait(&this->active, active, (unsigned int)left);
+        ATOMIC_SUB(&this->waiters, 1);
+        left = deadline - monotonic_ms();
     }
+
+    return 0;
 }
 
-/**
- * @brief error handler 
- */
-static void error_handler(int sig)
+METHOD(pool_group_t, group_wait_, void, private_group_t *this)
+{
+    int active = 0;
+
+    while ((active = ATOMIC_LOAD(&this->active)) != 0) {
+        ATOMIC_ADD(&this->waiters, 1);
+        futex_wait(&this->active, active);
+        ATOMIC_SUB(&this->waiters, 1);
+    }
+}
+
+METHOD(pool_group_t, group_destroy_, void, private_group_t *this)
+{
+    group_unref(this);
+}
+
+METHOD(pool_t, create_group_, pool_group_t *, private_pool_t *this)
 {
-    void *pool_ptr = NULL;
-    switch (sig) {
-        case SIGINT:
-        case SIGTERM:
-            if (pool_list) {
-                while (pool_list->remove_first(pool_list, &pool_ptr) != NOT_FOUND) {
+    private_group_t *group = NULL;
+
 #ifndef _WIN32
-                    _destroy_(pool_ptr);
+    INIT(group,
+        .public = {
+            .addjob     = _group_addjob_,
+            .cancel     = _group_cancel_,
+            .wait       = _group_wait_,
+            .timed_wait = _group_timed_wait_,
+            .destroy    = _group_destroy_,
+        },
+        .pool    = this,
+        .lock    = mutex_create(),
+        .queued  = NULL,
+        .active  = 0,
+        .waiters = 0,
+        .refs    = 1,
+    );
 #else
-                    destroy_(pool_ptr);
+    INIT(group, private_group_t,
+        {
+            group_addjob_,
+            group_cancel_,
+            group_wait_,
+            group_timed_wait_,
+            group_destroy_,
+        },
+        this,
+        mutex_create(),
+        NULL,
+        0,
+        0,
+        1,
+    );
 #endif
-                }
-                pool_list->destroy(pool_list);
-            }
-            exit(1);
-            break;
+    if (!group) return NULL;
+    if (!group->lock) {
+        free(group);
+        return NULL;
+    }
+
+    return &group->public;
+}
+
+METHOD(pool_t, get_stats_, pool_stats_t *, private_pool_t *this)
+{
+    pool_stats_t *stats = NULL;
+    worker_stats_t *slot = NULL;
+    task_deque_t *deque = NULL;
+    long depth = 0;
+    int i = 0, j = 0;
+
+    stats = calloc(1, sizeof(pool_stats_t) + pool_max_size * sizeof(pool_worker_stats_t));
+    if (!stats) return NULL;
+
+    /**
+     * tasks added to ring and heap are counted by their positions,
+     * tasks added to deques by the workers
+     */
+    stats->submitted = ATOMIC_LOAD(&ptask_queue->enqueue_pos);
+    this->prio_lock->lock(this->prio_lock);
+    stats->submitted += this->prio_seq;
+    this->prio_lock->unlock(this->prio_lock);
+    stats->completed = ATOMIC_LOAD(&this->helped);
+    stats->queued    = pool_queued(this);
+    stats->dropped   = ATOMIC_LOAD(&this->dropped);
+    stats->caller_ran = ATOMIC_LOAD(&this->caller_ran);
+
+    pthread_list_lock->lock(pthread_list_lock);
+    stats->cur_size     = pool_cur_size;
+    stats->idle_size    = ATOMIC_LOAD(&this->idle_size);
+    stats->min_size     = pool_min_size;
+    stats->max_size     = pool_max_size;
+    stats->worker_count = pool_max_size;
+    for (i = 0; i < pool_max_size; i++) {
+        stats->workers[i].active = pworkers[i] != NULL;
+    }
+    pthread_list_lock->unlock(pthread_list_lock);
+
+    for (i = 0; i < pool_max_size; i++) {
+        slot = &this->stats[i];
+        stats->workers[i].completed = ATOMIC_LOAD(&slot->completed);
+        stats->workers[i].busy_ns   = ATOMIC_LOAD(&slot->busy_ns);
+        stats->workers[i].spin_budget = ATOMIC_LOAD(&slot->spin_budget);
+        stats->workers[i].spins     = ATOMIC_LOAD(&slot->spins);
+        stats->workers[i].spin_hits = ATOMIC_LOAD(&slot->spin_hits);
+        stats->workers[i].parks     = ATOMIC_LOAD(&slot->parks);
+        stats->completed += stats->workers[i].completed;
+        stats->submitted += ATOMIC_LOAD(&slot->pushed);
+        for (j = 0; j < POOL_HIST_BUCKETS; j++) {
+            stats->wait.count[j] += ATOMIC_LOAD(&slot->wait.count[j]);
+            stats->run.count[j]  += ATOMIC_LOAD(&slot->run.count[j]);
+            stats->wake.count[j] += ATOMIC_LOAD(&slot->wake.count[j]);
+        }
+
+        deque = pdeques ? ATOMIC_LOAD(&pdeques[i]) : NULL;
+        if (!deque) continue;
+        depth = ATOMIC_LOAD(&deque->bottom) - ATOMIC_LOAD(&deque->top);
+        if (depth > 0) stats->queued += depth;
     }
+
+    return stats;
 }
 
 /**
- * @brief init thread pool 
+ * Described in header.
  */
-static int init_pool(private_pool_t *this)
+int future_wait_all(future_t *futures[], int n, int timeout)
 {
+    long long deadline = monotonic_ms() + timeout;
+    long long left     = 0;
     int i = 0;
 
+    for (i = 0; i < n; i++) {
+        if (!futures[i]) continue;
+        if (timeout < 0) {
+            futures[i]->wait(futures[i]);
+            continue;
+        }
+
+        left = deadline - monotonic_ms();
+        if (left < 0) left = 0;
+        if (futures[i]->timed_wait(futures[i], (unsigned int)left, NULL) != 0) return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Loop shared by all subranges of one parallel_for/parallel_reduce.
+ */
+typedef struct range_op_t range_op_t;
+struct range_op_t {
     /**
-     * act signal handler
+     * @brief pool running subranges
      */
-    signal(SIGINT, error_handler);
-    signal(SIGTERM, error_handler);
+    private_pool_t *pool;
 
     /**
-     * create thread in pool
+     * @brief size of range run without split
      */
-    for (i = 0; i < pool_min_size; i++) {
-        if (thread_pkg_init(this) < 0) break;
-    }
-    if (i < pool_min_size) return -1;
+    long grain;
 
     /**
-     * 1. create manager thread
-     * 2. create wait_job
-     * 3. create thread lock
+     * @brief loop body of parallel_for
      */
-    task_manager = thread_create((void *)task_manager_handler, this);
-    if (!task_manager) return -1;
-    if (this->enable_thread_manager) {
-        thread_manager = thread_create((void *)thread_manager_handler, this);
-        if (!thread_manager) return -1;
-    }
+    void (*body) (long begin, long end, void *ctx);
 
-    this->created = 1;
+    /**
+     * @brief loop body of parallel_reduce
+     */
+    void *(*map) (long begin, long end, void *ctx);
 
-    return 0;
-}
+    /**
+     * @brief combine results of adjacent ranges, left first
+     */
+    void *(*join) (void *left, void *right, void *ctx);
 
-METHOD(pool_t, addjob_, int, private_pool_t *this, void (*job) (void *), void *arg)
-{
-    thread_task_t *task = NULL;
+    /**
+     * @brief initial value of each subrange result
+     */
+    void *identity;
 
     /**
-     * if pool is not created completed, wait
+     * @brief parameter of callbacks
      */
-    while (!this->created) USLEEP(1);
-    if (!ptask_list) return -1;
-        
+    void *ctx;
+};
+
+/**
+ * Subrange split off to pool, lives on the stack of the splitter until
+ * it is done.
+ */
+struct range_node_t {
+    range_op_t *op;
+    long begin;
+    long end;
+    void *result;
+
     /**
-     * create task
+     * @brief 1 when done, futex word
      */
-    task = create_thread_task(job, arg);
-    if (!task) return -1;
+    int done;
+};
+
+/**
+ * @brief run range, split right half off to pool whenever a worker is
+ *        idle or spinning, otherwise run it grain by grain
+ */
+static void range_run(range_node_t *this)
+{
+    range_op_t *op       = this->op;
+    private_pool_t *pool = op->pool;
+    range_node_t children[DFT_RANGE_SPLITS];
+    range_node_t *child  = NULL;
+    long begin = this->begin, end = this->end, mid = 0, stop = 0;
+    unsigned long len = 0;
+    void *acc  = op->identity;
+    int cnt    = 0;
+
+    while (begin < end) {
+        /**
+         * length of a range spanning most of long overflows long
+         */
+        len = (unsigned long)end - (unsigned long)begin;
+        if (len > (unsigned long)op->grain && cnt < DFT_RANGE_SPLITS &&
+            (ATOMIC_LOAD(&pool->idle_size) > 0 || ATOMIC_LOAD(&pool->spin_size) > 0)) {
+            mid   = begin + (long)(len / 2);
+            child = &children[cnt];
+            child->op     = op;
+            child->begin  = mid;
+            child->end    = end;
+            child->result = op->identity;
+            child->done   = 0;
+            if (pool_addjob(pool, (void *)range_task, child, POOL_OVERFLOW_FAIL) == 0) {
+                cnt++;
+                end = mid;
+                continue;
+            }
+        }
+
+        stop = len > (unsigned long)op->grain ? begin + op->grain : end;
+        if (op->map) acc = op->join(acc, op->map(begin, stop, op->ctx), op->ctx);
+        else op->body(begin, stop, op->ctx);
+        begin = stop;
+    }
 
     /**
-     * add task to pool task list
+     * latest split is the nearest right neighbour, help pool while
+     * waiting, so that no thread blocks on a queued subrange, once
+     * nothing is left to help with the child is running somewhere and
+     * wakes us up when done
      */
-    task_lock->lock(task_lock);
-    ptask_list->insert_last(ptask_list, task);
-    pool_has_work->post(pool_has_work);
-    task_lock->unlock(task_lock);
+    while (cnt-- > 0) {
+        child = &children[cnt];
+        while (!ATOMIC_LOAD(&child->done)) {
+            if (pool_help(pool) != 0) futex_wait(&child->done, 0);
+        }
+        if (op->map) acc = op->join(acc, child->result, op->ctx);
+    }
+
+    this->result = acc;
+}
+
+/**
+ * @brief task handler of split subrange
+ */
+static void range_task(range_node_t *this)
+{
+    range_run(this);
+    ATOMIC_STORE(&this->done, 1);
+    futex_wake(&this->done, 1);
+}
+
+/**
+ * @brief run whole range in calling thread together with pool
+ */
+static void *range_start(range_op_t *op, long begin, long end)
+{
+    range_node_t root = {0};
+
+    if (op->grain <= 0) {
+        op->grain = (long)(((unsigned long)end - (unsigned long)begin) /
+                           (DFT_RANGE_CHUNKS * op->pool->max_size));
+        if (op->grain <= 0) op->grain = 1;
+    }
+
+    root.op     = op;
+    root.begin  = begin;
+    root.end    = end;
+    root.result = op->identity;
+    range_run(&root);
+
+    return root.result;
+}
+
+/**
+ * Described in header.
+ */
+int pool_parallel_for(pool_t *pool, long begin, long end, long grain,
+                      void (*fn) (long begin, long end, void *ctx), void *ctx)
+{
+    range_op_t op = {0};
+
+    if (!pool || !fn) return -1;
+    if (begin >= end) return 0;
+
+    op.pool  = (private_pool_t *)pool;
+    op.grain = grain;
+    op.body  = fn;
+    op.ctx   = ctx;
+    range_start(&op, begin, end);
 
     return 0;
 }
 
-pool_t *pool_create(int min_size, int max_size)
+/**
+ * Described in header.
+ */
+void *pool_parallel_reduce(pool_t *pool, long begin, long end, long grain, void *identity,
+                           void *(*fn) (long begin, long end, void *ctx),
+                           void *(*join) (void *left, void *right, void *ctx), void *ctx)
+{
+    range_op_t op = {0};
+
+    if (!pool || !fn || !join || begin >= end) return identity;
+
+    op.pool     = (private_pool_t *)pool;
+    op.grain    = grain;
+    op.map      = fn;
+    op.join     = join;
+    op.identity = identity;
+    op.ctx      = ctx;
+
+    return range_start(&op, begin, end);
+}
+
+/**
+ * Described in header.
+ */
+int pool_hist_bucket(unsigned long long value)
+{
+    int exp = 0;
+
+    if (value < (1 << POOL_HIST_SUB_BITS)) return (int)value;
+#ifndef _WIN32
+    exp = 63 - __builtin_clzll(value);
+#else
+    while (value >> (exp + 1)) exp++;
+#endif
+    if (exp >= POOL_HIST_MAX_BITS) return POOL_HIST_BUCKETS - 1;
+
+    return ((exp - POOL_HIST_SUB_BITS + 1) << POOL_HIST_SUB_BITS) +
+           (int)((value >> (exp - POOL_HIST_SUB_BITS)) & ((1 << POOL_HIST_SUB_BITS) - 1));
+}
+
+/**
+ * Described in header.
+ */
+unsigned long long pool_hist_value(int bucket)
+{
+    int exp = 0, sub = 0;
+
+    if (bucket < (1 << POOL_HIST_SUB_BITS)) return bucket;
+    exp = (bucket >> POOL_HIST_SUB_BITS) + POOL_HIST_SUB_BITS - 1;
+    sub = bucket & ((1 << POOL_HIST_SUB_BITS) - 1);
+
+    return (unsigned long long)((1 << POOL_HIST_SUB_BITS) + sub) << (exp - POOL_HIST_SUB_BITS);
+}
+
+/**
+ * Described in header.
+ */
+unsigned long long pool_hist_percentile(const pool_hist_t *hist, double percent)
+{
+    unsigned long long total = 0, seen = 0, target = 0;
+    int i = 0;
+
+    for (i = 0; i < POOL_HIST_BUCKETS; i++) total += hist->count[i];
+    if (total == 0) return 0;
+
+    target = (unsigned long long)(total * percent / 100);
+    if (target < 1) target = 1;
+    if (target > total) target = total;
+    for (i = 0; i < POOL_HIST_BUCKETS; i++) {
+        seen += hist->count[i];
+        if (seen >= target) break;
+    }
+    if (i >= POOL_HIST_BUCKETS - 1) return pool_hist_value(POOL_HIST_BUCKETS - 1);
+
+    return pool_hist_value(i + 1) - 1;
+}
+
+pool_t *pool_create_ext(pool_attr_t *attr)
 {
     private_pool_t *this;
 
+    if (!attr) return NULL;
+
 #ifndef _WIN32
     INIT(this,
         .public = {
             .addjob  = _addjob_,
+            .addjobs = _addjobs_,
+            .addjob_prio   = _addjob_prio_,
+            .addjob_keyed  = _addjob_keyed_,
+            .addjob_future = _addjob_future_,
+            .create_group  = _create_group_,
+            .get_stats     = _get_stats_,
+            .addjob_after  = _addjob_after_,
+            .addjob_every  = _addjob_every_,
+            .shutdown      = _shutdown_,
             .destroy = _destroy_,
         },
-        .created               = 0,
         .enable_thread_manager = 1,
-        .task_manager_stop     = 0,
+        .flags                 = attr->flags,
+        .stop                  = 0,
         .thread_manager_stop   = 0,
-        .min_size              = min_size,
+        .min_size              = attr->min_size,
         .cur_size              = 0,
-        .max_size              = max_size,
-        .busy_thread_list      = linked_list_create(),
-        .idle_thread_list      = linked_list_create(),
-        .task_list             = linked_list_create(),
-        .task_list_manager     = NULL,
+        .max_size              = attr->max_size,
+        .grow_depth            = attr->grow_depth > 0 ? attr->grow_depth : DFT_GROW_QUEUE_DEPTH,
+        .grow_latency          = (long long)(attr->grow_latency > 0 ? attr->grow_latency : DFT_GROW_WAIT_LATENCY) * 1000000,
+        .idle_timeout          = attr->idle_timeout > 0 ? attr->idle_timeout : DFT_IDLE_THREAD_FREE_TIME * 1000,
+        .grow_pending          = 0,
+        .started               = 0,
+        .idle_size             = 0,
+        .workers               = NULL,
+        .deques                = NULL,
+        .queue_size            = attr->queue_size > 0 ? attr->queue_size : DFT_TASK_QUEUE_SIZE,
         .thread_list_manager   = NULL,
         .thread_list_lock      = mutex_create(),
-        .task_list_lock        = mutex_create(),
-        .has_work              = bsem_create(0),
-        .has_idle_thread       = bsem_create(0),
+        .prio_heap             = NULL,
+        .prio_count            = 0,
+        .prio_top              = 0,
+        .prio_seq              = 0,
+        .prio_aging            = (long long)(attr->prio_aging > 0 ? attr->prio_aging : DFT_PRIO_AGING) * 1000000,
+        .prio_lock             = mutex_create(),
+        .has_work              = 0,
+        .future_free           = NULL,
+        .future_lock           = mutex_create(),
+        .strands               = NULL,
+        .cpus                  = NULL,
+        .cpu_count             = 0,
+        .stats                 = NULL,
+        .helped                = 0,
+        .closed                = 0,
+        .park_seq              = 0,
+        .wheel                 = NULL,
+        .timer_thread          = NULL,
+        .timer_lock            = mutex_create(),
+        .timer_seq             = 0,
+        .timer_stop            = 0,
+        .spin_max              = attr->spin_time < 0 ? 0 : (long long)(attr->spin_time > 0 ? attr->spin_time : DFT_SPIN_TIME) * 1000,
+        .spin_size             = 0,
+        .post_stamp            = 0,
+        .overflow              = attr->overflow,
+        .space_waiters         = 0,
+        .space_seq             = 0,
+        .dropped               = 0,
+        .caller_ran            = 0,
+        .worker_init           = attr->worker_init,
+        .worker_exit           = attr->worker_exit,
+        .worker_ctx            = attr->worker_ctx,
     );
 #else
-    INIT(this, private_pool_t, 
+    INIT(this, private_pool_t,
         {
             addjob_,
+            addjobs_,
+            addjob_prio_,
+            addjob_keyed_,
+            addjob_future_,
+            create_group_,
+            get_stats_,
+            addjob_after_,
+            addjob_every_,
+            shutdown_,
             destroy_,
         },
-        0,
         1,
+        attr->flags,
+        0,
+        0,
+        attr->min_size,
         0,
+        attr->max_size,
+        attr->grow_depth > 0 ? attr->grow_depth : DFT_GROW_QUEUE_DEPTH,
+        (long long)(attr->grow_latency > 0 ? attr->grow_latency : DFT_GROW_WAIT_LATENCY) * 1000000,
+        attr->idle_timeout > 0 ? attr->idle_timeout : DFT_IDLE_THREAD_FREE_TIME * 1000,
         0,
-        min_size,
         0,
-        max_size,
-        linked_list_create(),
-        linked_list_create(),
-        linked_list_create(),
+        0,
+        NULL,
+        NULL,
+        attr->queue_size > 0 ? attr->queue_size : DFT_TASK_QUEUE_SIZE,
+        {0},
+        NULL,
+        mutex_create(),
         NULL,
+        0,
+        0,
+        0,
+        (long long)(attr->prio_aging > 0 ? attr->prio_aging : DFT_PRIO_AGING) * 1000000,
+        mutex_create(),
+        0,
         NULL,
         mutex_create(),
+        NULL,
+        NULL,
+        0,
+        NULL,
+        0,
+        0,
+        0,
+        NULL,
+        NULL,
         mutex_create(),
-        bsem_create(100),
-        bsem_create(max_size),
+        0,
+        0,
+        attr->spin_time < 0 ? 0 : (long long)(attr->spin_time > 0 ? attr->spin_time : DFT_SPIN_TIME) * 1000,
+        0,
+        0,
+        attr->overflow,
+        0,
+        0,
+        0,
+        0,
+        attr->worker_init,
+        attr->worker_exit,
+        attr->worker_ctx,
     );
 #endif
 
     /**
      * start thread pool
      */
-    if (init_pool(this) != 0) {
+    if (init_cpus(this, attr) != 0 || init_pool(this) != 0) {
 #ifndef _WIN32
         _destroy_(this);
 #else
@@ -733,10 +3872,49 @@ pool_t *pool_create(int min_size, int max_size)
         return NULL;
     }
 
+    return &this->public;
+}
+
+pool_t *pool_create(int min_size, int max_size)
+{
+    pool_attr_t attr = {0};
+
+    attr.min_size = min_size;
+    attr.max_size = max_size;
+
+    return pool_create_ext(&attr);
+}
+
+/**
+ * Described in header.
+ */
+pool_t *pool_default()
+{
+    private_pool_t *this = ATOMIC_LOAD(&default_pool), *expected = NULL;
+    pool_t *pool = NULL;
+    int cpus = 0;
+
+    if (this) return &this->public;
+
     /**
-     * add this thread pool to pool list
+     * first callers race to create it, losers destroy their own
      */
-    if (!pool_list) pool_list = linked_list_create();
-    pool_list->insert_last(pool_list, this);
+    cpus = online_cpus();
+    pool = pool_create(cpus, cpus);
+    if (!pool) return NULL;
+    this = (private_pool_t *)pool;
+    if (!ATOMIC_CAS(&default_pool, &expected, this)) {
+        pool->destroy(pool);
+        this = expected;
+    }
+
     return &this->public;
 }
+
+/**
+ * Described in header.
+ */
+void *pool_worker_local()
+{
+    return current_worker ? current_worker->local : NULL;
+}
@@ -2,28 +2,539 @@
 #define __POOL_H__
 
 #define DFT_IDLE_THREAD_FREE_TIME (10)
+#define DFT_GROW_QUEUE_DEPTH      (1)
+#define DFT_GROW_WAIT_LATENCY     (10)
+#define DFT_PRIO_AGING            (100)
+#define DFT_SPIN_TIME             (50)
+#define DFT_WORKER_DEQUE_SIZE     (1024)
+#define DFT_TASK_QUEUE_SIZE       (8192)
+#define DFT_RANGE_SPLITS          (32)
+#define DFT_RANGE_CHUNKS          (8)
+#define DFT_STRAND_BUCKETS        (64)
+#define DFT_STRAND_BATCH          (16)
+
+/**
+ * histogram buckets, values below 2^POOL_HIST_SUB_BITS have own bucket,
+ * above that each power of 2 is split in 2^POOL_HIST_SUB_BITS buckets,
+ * covers up to 2^POOL_HIST_MAX_BITS ns with 1/8 relative error
+ */
+#define POOL_HIST_SUB_BITS        (3)
+#define POOL_HIST_MAX_BITS        (42)
+#define POOL_HIST_BUCKETS         ((POOL_HIST_MAX_BITS - POOL_HIST_SUB_BITS + 1) << POOL_HIST_SUB_BITS)
+
+typedef enum pool_flag_t pool_flag_t;
+enum pool_flag_t {
+    /**
+     * jobs added from inside a running job go to the worker's own
+     * deque, idle workers steal from the others
+     */
+    POOL_WORK_STEALING = 1 << 0,
+
+    /**
+     * worker slot i runs only on i-th cpu process may run on, round
+     * robin, unless pool_attr_t.cpus is given
+     */
+    POOL_CPU_AFFINITY  = 1 << 1,
+};
+
+typedef enum pool_prio_t pool_prio_t;
+enum pool_prio_t {
+    POOL_PRIO_HIGH   = 0,
+    POOL_PRIO_NORMAL = 1,
+    POOL_PRIO_LOW    = 2,
+};
+
+typedef enum pool_shutdown_t pool_shutdown_t;
+enum pool_shutdown_t {
+    /**
+     * run every queued job, and jobs they add, then stop threads
+     */
+    POOL_SHUTDOWN_DRAIN = 0,
+
+    /**
+     * drop queued jobs, only running jobs finish
+     */
+    POOL_SHUTDOWN_DROP  = 1,
+};
+
+typedef enum pool_overflow_t pool_overflow_t;
+enum pool_overflow_t {
+    /**
+     * adding to full queue fails
+     */
+    POOL_OVERFLOW_FAIL        = 0,
+
+    /**
+     * adding to full queue waits for room, a job of the pool runs the
+     * new job itself instead of waiting
+     */
+    POOL_OVERFLOW_BLOCK       = 1,
+
+    /**
+     * adding to full queue runs the job in the caller
+     */
+    POOL_OVERFLOW_CALLER_RUNS = 2,
+
+    /**
+     * adding to full queue drops the oldest queued job, priority jobs
+     * are not dropped, adding them fails
+     */
+    POOL_OVERFLOW_DROP_OLDEST = 3,
+};
+
+typedef struct pool_attr_t pool_attr_t;
+struct pool_attr_t {
+    /**
+     * @brief pool thread min size
+     */
+    int min_size;
+
+    /**
+     * @brief pool thread max size
+     */
+    int max_size;
+
+    /**
+     * @brief pool_flag_t combination
+     */
+    int flags;
+
+    /**
+     * @brief max depth of pool task queue, rounded up to power of 2,
+     *        and of priority queue, DFT_TASK_QUEUE_SIZE if 0
+     */
+    int queue_size;
+
+    /**
+     * @brief pool_overflow_t, what adding to a full queue does
+     */
+    int overflow;
+
+    /**
+     * @brief add threads when more tasks than this are queued and no
+     *        thread is idle, DFT_GROW_QUEUE_DEPTH if 0
+     */
+    int grow_depth;
+
+    /**
+     * @brief add threads when a task waited longer than this in ms and
+     *        no thread is idle, DFT_GROW_WAIT_LATENCY if 0
+     */
+    int grow_latency;
+
+    /**
+     * @brief thread above min_size exits after idle for this in ms,
+     *        DFT_IDLE_THREAD_FREE_TIME seconds if 0
+     */
+    unsigned int idle_timeout;
+
+    /**
+     * @brief waiting time in ms worth one priority level, a task waiting
+     *        this long runs before new tasks one level higher,
+     *        DFT_PRIO_AGING if 0
+     */
+    int prio_aging;
+
+    /**
+     * @brief time in us an idle thread spins for work before sleeping,
+     *        adapted per thread up to this, DFT_SPIN_TIME if 0, less than
+     *        0 or a single cpu never spins
+     */
+    int spin_time;
+
+    /**
+     * @brief worker slot i runs only on cpus[i % cpu_count], can be NULL,
+     *        give cpus of one socket to keep memory of pool on its node
+     */
+    const int *cpus;
+
+    /**
+     * @brief count of cpus
+     */
+    int cpu_count;
+
+    /**
+     * @brief called by every worker before its first job, result is the
+     *        worker local data jobs get by pool_worker_local(), can be NULL
+     */
+    void *(*worker_init) (void *ctx);
+
+    /**
+     * @brief called by every worker with its local data when it exits,
+     *        before destroy returns, can be NULL
+     */
+    void (*worker_exit) (void *local, void *ctx);
+
+    /**
+     * @brief context passed to worker_init and worker_exit
+     */
+    void *worker_ctx;
+};
+
+typedef struct pool_hist_t pool_hist_t;
+struct pool_hist_t {
+    /**
+     * @brief count of values, ns, in each bucket
+     */
+    unsigned long long count[POOL_HIST_BUCKETS];
+};
+
+typedef struct pool_worker_stats_t pool_worker_stats_t;
+struct pool_worker_stats_t {
+    /**
+     * @brief whether a thread runs in this worker slot now
+     */
+    int active;
+
+    /**
+     * @brief tasks run in this slot
+     */
+    unsigned long long completed;
+
+    /**
+     * @brief time spent running tasks in this slot, in ns
+     */
+    unsigned long long busy_ns;
+
+    /**
+     * @brief current spin budget, in ns
+     */
+    unsigned long long spin_budget;
+
+    /**
+     * @brief times spun for work, and times work came while spinning
+     */
+    unsigned long long spins;
+    unsigned long long spin_hits;
+
+    /**
+     * @brief times went to sleep
+     */
+    unsigned long long parks;
+};
+
+typedef struct pool_stats_t pool_stats_t;
+struct pool_stats_t {
+    /**
+     * @brief tasks added to pool queues
+     */
+    unsigned long long submitted;
+
+    /**
+     * @brief tasks run
+     */
+    unsigned long long completed;
+
+    /**
+     * @brief tasks waiting in pool queues
+     */
+    int queued;
+
+    /**
+     * @brief tasks dropped by POOL_OVERFLOW_DROP_OLDEST, and tasks run
+     *        by callers since queue was full
+     */
+    unsigned long long dropped;
+    unsigned long long caller_ran;
+
+    /**
+     * @brief thread counts
+     */
+    int cur_size;
+    int idle_size;
+    int min_size;
+    int max_size;
+
+    /**
+     * @brief time tasks waited in queue, from adding to start
+     */
+    pool_hist_t wait;
+
+    /**
+     * @brief time tasks ran
+     */
+    pool_hist_t run;
+
+    /**
+     * @brief time from waking up a sleeping thread until it runs
+     */
+    pool_hist_t wake;
+
+    /**
+     * @brief count of workers, max_size
+     */
+    int worker_count;
+
+    /**
+     * @brief stats of each worker slot
+     */
+    pool_worker_stats_t workers[];
+};
+
+typedef struct future_t future_t;
+struct future_t {
+    /**
+     * @brief wait until job done
+     * @return      result of job
+     */
+    void *(*wait) (future_t *this);
+
+    /**
+     * @brief wait until job done or timed out
+     * @param timeout  timeout in ms
+     * @param result   [out] result of job, can be NULL
+     * @return         0 if done, -1 if timed out
+     */
+    int (*timed_wait) (future_t *this, unsigned int timeout, void **result);
+
+    /**
+     * @brief whether job done, never blocks
+     */
+    int (*is_done) (future_t *this);
+
+    /**
+     * @brief run job on pool once this job done, without blocking a thread
+     * @param job   continuation, gets arg and result of this job
+     * @param arg   parameter of continuation
+     * @return      future of continuation, NULL if failed
+     */
+    future_t *(*then) (future_t *this, void *(*job) (void *arg, void *result), void *arg);
+
+    /**
+     * @brief give handle back to pool, job still runs if not done
+     */
+    void (*destroy) (future_t *this);
+};
+
+typedef struct pool_group_t pool_group_t;
+struct pool_group_t {
+    /**
+     * @brief add task to group, runs on pool like addjob
+     * @param job   task
+     * @param arg   parameter of task
+     * @return      0 if succ, -1 if failed or task queue is full
+     */
+    int (*addjob) (pool_group_t *this, void (*job) (void *), void *arg);
+
+    /**
+     * @brief cancel tasks of group not started yet, running ones finish
+     * @return      count of tasks cancelled
+     */
+    int (*cancel) (pool_group_t *this);
+
+    /**
+     * @brief wait until every task added so far finished or was
+     *        cancelled, tasks dropped by pool count as cancelled
+     */
+    void (*wait) (pool_group_t *this);
+
+    /**
+     * @brief wait like wait, at most timeout
+     * @param timeout  timeout in ms
+     * @return         0 if done, -1 if timed out
+     */
+    int (*timed_wait) (pool_group_t *this, unsigned int timeout);
+
+    /**
+     * @brief give handle back to pool, queued tasks still run
+     */
+    void (*destroy) (pool_group_t *this);
+};
+
+typedef struct pool_timer_t pool_timer_t;
+struct pool_timer_t {
+    /**
+     * @brief stop timer, a running job finishes, periodic one does not
+     *        run again
+     * @return      0 if stopped before job ran (again), -1 if too late
+     */
+    int (*cancel) (pool_timer_t *this);
+
+    /**
+     * @brief give handle back to pool, timer still fires, can be called
+     *        after pool is destroyed, cancel can not
+     */
+    void (*destroy) (pool_timer_t *this);
+};
 
 typedef struct pool_t pool_t;
 struct pool_t {
     /**
      * @brief add task to thread pool
-     * @param work  task 
+     * @param work  task
      * @param arg   parameter of task
+     * @return      0 if succ, -1 if failed or task queue is full and
+     *              policy is POOL_OVERFLOW_FAIL
      */
     int (*addjob) (pool_t *this, void (*job) (void *), void *arg);
 
     /**
-     * @brief destroy instance and free memory 
+     * @brief add a batch of tasks, wakes up min(n, idle) threads at once
+     * @param job   tasks
+     * @param arg   parameter of each task, can be NULL
+     * @param n     count of tasks
+     * @return      count of tasks added or run by overflow policy, less
+     *              than n if task queue is full, -1 if failed
+     */
+    int (*addjobs) (pool_t *this, void (*job[]) (void *), void *arg[], int n);
+
+    /**
+     * @brief add task with priority, the task due first runs first
+     * @param prio      pool_prio_t, or any level from 0 (highest)
+     * @param deadline  run before this in ms from now, 0 for none
+     * @param job       task
+     * @param arg       parameter of task
+     * @return          0 if succ, -1 if failed or queue is full and
+     *                  policy is POOL_OVERFLOW_FAIL or DROP_OLDEST
+     */
+    int (*addjob_prio) (pool_t *this, int prio, unsigned int deadline, void (*job) (void *), void *arg);
+
+    /**
+     * @brief add task ordered by key, tasks of same key run one at a time
+     *        in order of adding, tasks of different keys run in parallel,
+     *        runs in caller if task queue is full
+     * @param key   key, like fd of connection
+     * @param job   task
+     * @param arg   parameter of task
+     * @return      0 if succ, -1 if failed
+     */
+    int (*addjob_keyed) (pool_t *this, unsigned long key, void (*job) (void *), void *arg);
+
+    /**
+     * @brief add task whose completion and result can be waited for,
+     *        futures are recycled by pool, destroy them before pool
+     * @param job   task, returns result
+     * @param arg   parameter of task
+     * @return      future of task, NULL if failed or task queue is full
+     */
+    future_t *(*addjob_future) (pool_t *this, void *(*job) (void *), void *arg);
+
+    /**
+     * @brief create group of tasks which can be cancelled and waited for
+     *        together, like the work of one client
+     * @return      group, destroy it when not needed, NULL if failed
+     */
+    pool_group_t *(*create_group) (pool_t *this);
+
+    /**
+     * @brief snapshot of pool statistics, summed from per worker counters,
+     *        counters are not read at one instant
+     * @return      stats, free it by free(), NULL if failed
+     */
+    pool_stats_t *(*get_stats) (pool_t *this);
+
+    /**
+     * @brief run task on pool once after delay, timers of pool are kept
+     *        in a timing wheel with ms ticks, served by one thread
+     * @param delay  delay in ms
+     * @param job    task
+     * @param arg    parameter of task
+     * @return       timer, destroy it when not needed, NULL if failed
+     */
+    pool_timer_t *(*addjob_after) (pool_t *this, unsigned int delay, void (*job) (void *), void *arg);
+
+    /**
+     * @brief run task on pool every period, first after one period, runs
+     *        at fixed rate until cancelled or pool shut down
+     * @param period period in ms, not 0
+     * @return       timer, destroy it when not needed, NULL if failed
+     */
+    pool_timer_t *(*addjob_every) (pool_t *this, unsigned int period, void (*job) (void *), void *arg);
+
+    /**
+     * @brief stop taking jobs and join every thread, returns when all
+     *        running jobs finished, futures of dropped jobs never finish,
+     *        pending timers never fire, not from jobs of pool
+     * @param mode  pool_shutdown_t
+     * @return      0 if succ, -1 if already shut down, default pool or
+     *              called from a thread of pool
+     */
+    int (*shutdown) (pool_t *this, pool_shutdown_t mode);
+
+    /**
+     * @brief destroy instance and free memory, drops pending jobs if
+     *        not shut down, does nothing if called from a thread of pool
      */
     void (*destroy) (pool_t *this);
 };
 
 /**
- * @brief create pool instance 
+ * @brief create pool instance
  * @param min_size   pool thread min size
  * @param max_size   pool thread max size
- * @param enable_thread_manager enable or disable thread manager
  */
 pool_t *pool_create(int min_size, int max_size);
 
+/**
+ * @brief create pool instance with attributes
+ * @param attr       pool attributes
+ */
+pool_t *pool_create_ext(pool_attr_t *attr);
+
+/**
+ * @brief process wide pool, one worker per online cpu, created by first
+ *        call, shared by every caller, shutdown and destroy on it are
+ *        ignored
+ * @return           default pool, NULL if it could not be created
+ */
+pool_t *pool_default();
+
+/**
+ * @brief worker local data of calling thread, made by worker_init of its
+ *        pool, reuse it for scratch buffers or caches across jobs
+ * @return           local data, NULL if not called from a pool worker, e.g.
+ *                   a job run by a producer or by a thread helping wait
+ */
+void *pool_worker_local();
+
+/**
+ * @brief wait until all jobs done
+ * @param futures    futures, NULL entries are skipped
+ * @param n          count of futures
+ * @param timeout    timeout in ms for the whole set, less than 0 for ever
+ * @return           0 if all done, -1 if timed out
+ */
+int future_wait_all(future_t *futures[], int n, int timeout);
+
+/**
+ * @brief run fn over [begin, end) on pool and calling thread, ranges are
+ *        split in halves while workers are idle, returns when all done
+ * @param grain      size of range never split, chosen by pool if 0
+ * @param fn         loop body, called with subranges
+ * @param ctx        parameter of fn
+ * @return           0 if succ, -1 if failed
+ */
+int pool_parallel_for(pool_t *pool, long begin, long end, long grain,
+                      void (*fn) (long begin, long end, void *ctx), void *ctx);
+
+/**
+ * @brief like pool_parallel_for, results of subranges are combined by join
+ * @param identity   result of empty range
+ * @param fn         loop body, returns result of subrange
+ * @param join       combines results of adjacent subranges, must be
+ *                   associative, left one comes first
+ * @return           result of whole range
+ */
+void *pool_parallel_reduce(pool_t *pool, long begin, long end, long grain, void *identity,
+                           void *(*fn) (long begin, long end, void *ctx),
+                           void *(*join) (void *left, void *right, void *ctx), void *ctx);
+
+/**
+ * @brief histogram bucket of value
+ */
+int pool_hist_bucket(unsigned long long value);
+
+/**
+ * @brief smallest value of histogram bucket
+ */
+unsigned long long pool_hist_value(int bucket);
+
+/**
+ * @brief value not exceeded by given percent of values, rounded up to
+ *        end of its bucket
+ * @param percent    0 to 100
+ * @return           0 if histogram is empty
+ */
+unsigned long long pool_hist_percentile(const pool_hist_t *hist, double percent);
+
 #endif /* __POOL_H__ */
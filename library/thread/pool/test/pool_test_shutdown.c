@@ -0,0 +1,59 @@
+/**
+ * shutdown and destroy called from jobs of pool are refused instead of
+ * joining the calling thread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); exit(1); } \
+} while (0)
+
+static pool_t *pool;
+static int refused;
+
+static void job(void *arg)
+{
+    if (pool->shutdown(pool, POOL_SHUTDOWN_DRAIN) == -1) __atomic_add_fetch(&refused, 1, __ATOMIC_RELAXED);
+    pool->destroy(pool);
+}
+
+static void *future_job(void *arg)
+{
+    return NULL;
+}
+
+static void *future_cont(void *arg, void *result)
+{
+    job(arg);
+    return NULL;
+}
+
+int main()
+{
+    future_t *future = NULL, *cont = NULL;
+    pool_timer_t *timer = NULL;
+
+    pool = pool_create(2, 2);
+    CHECK(pool);
+
+    CHECK(pool->addjob(pool, job, NULL) == 0);
+    timer  = pool->addjob_after(pool, 1, job, NULL);
+    future = pool->addjob_future(pool, future_job, NULL);
+    CHECK(timer && future);
+    cont = future->then(future, future_cont, NULL);
+    CHECK(cont);
+    cont->wait(cont);
+    while (__atomic_load_n(&refused, __ATOMIC_ACQUIRE) < 3) usleep(1000);
+
+    cont->destroy(cont);
+    future->destroy(future);
+    timer->destroy(timer);
+    CHECK(pool->shutdown(pool, POOL_SHUTDOWN_DRAIN) == 0);
+    pool->destroy(pool);
+    printf("pool_test_shutdown ok\n");
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * timer and future handles outliving their pool, and timer and future
+ * jobs dropped by shutdown, run under address sanitizer
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+
+static int release;
+static int ran;
+
+static void block(void *arg)
+{
+    while (!__atomic_load_n(&release, __ATOMIC_ACQUIRE)) usleep(1000);
+}
+
+static void job(void *arg)
+{
+    __atomic_add_fetch(&ran, 1, __ATOMIC_RELAXED);
+}
+
+static void *future_job(void *arg)
+{
+    __atomic_add_fetch(&ran, 1, __ATOMIC_RELAXED);
+    return arg;
+}
+
+static void *future_cont(void *arg, void *result)
+{
+    __atomic_add_fetch(&ran, 1, __ATOMIC_RELAXED);
+    return result;
+}
+
+static void *releaser(void *arg)
+{
+    usleep(50000);
+    __atomic_store_n(&release, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); exit(1); } \
+} while (0)
+
+/**
+ * pending timers are freed with pool only when their handle is gone
+ */
+static void test_timer_outlives_pool()
+{
+    pool_t *pool = pool_create(2, 2);
+    pool_timer_t *once = NULL, *every = NULL;
+
+    CHECK(pool);
+    once  = pool->addjob_after(pool, 100000, job, NULL);
+    every = pool->addjob_every(pool, 100000, job, NULL);
+    CHECK(once && every);
+    pool->destroy(pool);
+    once->destroy(once);
+    every->destroy(every);
+}
+
+/**
+ * timer and future jobs queued behind a running job are dropped by
+ * shutdown, their records are not leaked
+ */
+static void test_drop_queued()
+{
+    pool_t *pool = pool_create(1, 1);
+    pool_timer_t *timer = NULL;
+    future_t *future = NULL, *cont = NULL, *late = NULL;
+    pthread_t thread;
+
+    CHECK(pool);
+    __atomic_store_n(&release, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&ran, 0, __ATOMIC_RELEASE);
+    CHECK(pool->addjob(pool, block, NULL) == 0);
+
+    timer  = pool->addjob_after(pool, 1, job, NULL);
+    future = pool->addjob_future(pool, future_job, NULL);
+    CHECK(timer && future);
+    cont = future->then(future, future_cont, NULL);
+    CHECK(cont);
+
+    /**
+     * timer thread queues expired timer behind blocking job
+     */
+    usleep(20000);
+    pthread_create(&thread, NULL, releaser, NULL);
+    CHECK(pool->shutdown(pool, POOL_SHUTDOWN_DROP) == 0);
+    pthread_join(thread, NULL);
+
+    CHECK(__atomic_load_n(&ran, __ATOMIC_ACQUIRE) == 0);
+    CHECK(!future->is_done(future) && !cont->is_done(cont));
+    late = future->then(future, future_cont, NULL);
+    CHECK(late && !late->is_done(late));
+
+    late->destroy(late);
+    cont->destroy(cont);
+    future->destroy(future);
+    timer->destroy(timer);
+    pool->destroy(pool);
+}
+
+int main()
+{
+    test_timer_outlives_pool();
+    test_drop_queued();
+    printf("pool_test_timer ok\n");
+
+    return 0;
+}
@@ -1,9 +1,13 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 
 #include "thread.h"
 #ifndef _WIN32
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -228,6 +232,31 @@ METHOD(thread_t, get_id_, int, private_thread_t *this)
     return this->id;
 }
 
+METHOD(thread_t, set_affinity_, int, private_thread_t *this, const int cpus[], int n)
+{
+	int i;
+#ifndef _WIN32
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	for (i = 0; i < n; i++)
+	{
+		if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+	}
+	if (CPU_COUNT(&set) == 0) return -1;
+	return pthread_setaffinity_np(this->thread_id, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+	DWORD_PTR mask = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		if (cpus[i] >= 0 && cpus[i] < (int)sizeof(mask) * 8) mask |= (DWORD_PTR)1 << cpus[i];
+	}
+	if (!mask) return -1;
+	return SetThreadAffinityMask(this->thread_id, mask) ? 0 : -1;
+#endif
+}
+
 /**
  * Main function wrapper for threads.
  */
@@ -250,6 +279,10 @@ static void *thread_main(private_thread_t *this)
     */
 
 	res = this->main(this->arg);
+
+	/* free thread object here if it was joined or detached already,
+	 * otherwise join or detach frees it */
+	thread_cleanup(this);
     this = NULL;
     return res;
 }
@@ -297,6 +330,7 @@ static private_thread_t *thread_create_internal()
 			.destroy = _destroy_,
 
 			.get_id  = _get_id_,
+			.set_affinity = _set_affinity_,
 		},
 		.mutex = mutex_create(),
 	);
@@ -311,6 +345,7 @@ static private_thread_t *thread_create_internal()
 			destroy_,
 
 			get_id_,
+			set_affinity_,
 		},
 		0,
 		0,
@@ -323,7 +358,13 @@ static private_thread_t *thread_create_internal()
 	);
 #endif
 	this->created = bsem_create(0);
-	id_mutex = mutex_create();
+	if (!ATOMIC_LOAD(&id_mutex))
+	{
+		/* first thread installs it, others racing with it drop their own */
+		mutex_t *mutex = mutex_create(), *expected = NULL;
+
+		if (!ATOMIC_CAS(&id_mutex, &expected, mutex)) mutex->destroy(mutex);
+	}
 
 	return this;
 }
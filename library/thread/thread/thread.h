@@ -16,10 +16,12 @@
 typedef pthread_t THREAD_HANDLE;
 #define GET_THREAD_ID() pthread_self()
 #define THREAD_JOIN(id) pthread_join(id, NULL)
+#define THREAD_LOCAL __thread
 #else
 typedef HANDLE THREAD_HANDLE;
 #define GET_THREAD_ID() GetCurrentThreadId()
 #define THREAD_JOIN(id) WaitForSingleObject(id, INFINITE) 
+#define THREAD_LOCAL __declspec(thread)
 #endif
 
 typedef struct thread_t thread_t;
@@ -92,6 +94,14 @@ struct thread_t {
      * @brief get thread id
      */
     int (*get_id) (thread_t *this);
+
+    /**
+     * @brief run thread only on given cpus
+     * @param cpus   cpu numbers, as in sched_getaffinity
+     * @param n      count of cpus
+     * @return       0 if succ, -1 if failed
+     */
+    int (*set_affinity) (thread_t *this, const int cpus[], int n);
 };
 
 
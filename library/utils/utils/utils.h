@@ -246,6 +246,87 @@ typedef clock_t tclock_t;
 */
 #define ASSIGN(method, function) (method = (typeof(method))function)
 
+/**
+* Atomic operations, loads acquire, stores release, others are full barriers
+*/
+#ifndef _WIN32
+#define ATOMIC_LOAD(ptr)            __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, val)      __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define ATOMIC_ADD(ptr, val)        __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB(ptr, val)        __atomic_sub_fetch(ptr, val, __ATOMIC_SEQ_CST)
+#define ATOMIC_XCHG(ptr, val)       __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS(ptr, oldp, val)  __atomic_compare_exchange_n(ptr, oldp, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE()              __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+/**
+ * Interlocked functions sized by operand, 4 or 8 bytes, pointers and
+ * integers alike, values pass as LONG64
+ */
+static __inline LONG64 atomic_add_(volatile void *ptr, LONG64 val, size_t size)
+{
+    if (size == 8) return InterlockedExchangeAdd64((volatile LONG64 *)ptr, val) + val;
+    return (LONG)(InterlockedExchangeAdd((volatile LONG *)ptr, (LONG)val) + (LONG)val);
+}
+
+static __inline LONG64 atomic_xchg_(volatile void *ptr, LONG64 val, size_t size)
+{
+    if (size == 8) return InterlockedExchange64((volatile LONG64 *)ptr, val);
+    return InterlockedExchange((volatile LONG *)ptr, (LONG)val);
+}
+
+/**
+ * like __atomic_compare_exchange_n, value seen is written back to oldp
+ * when it differs
+ */
+static __inline int atomic_cas_(volatile void *ptr, void *oldp, LONG64 val, size_t size)
+{
+    LONG64 old64 = 0, seen64 = 0;
+    LONG old32 = 0, seen32 = 0;
+
+    if (size == 8) {
+        old64  = *(LONG64 *)oldp;
+        seen64 = InterlockedCompareExchange64((volatile LONG64 *)ptr, val, old64);
+        if (seen64 == old64) return 1;
+        *(LONG64 *)oldp = seen64;
+        return 0;
+    }
+    old32  = *(LONG *)oldp;
+    seen32 = InterlockedCompareExchange((volatile LONG *)ptr, (LONG)val, old32);
+    if (seen32 == old32) return 1;
+    *(LONG *)oldp = seen32;
+    return 0;
+}
+
+#define ATOMIC_LOAD(ptr)            (MemoryBarrier(), *(ptr))
+#define ATOMIC_STORE(ptr, val)      do { MemoryBarrier(); *(ptr) = (val); MemoryBarrier(); } while (0)
+#define ATOMIC_ADD(ptr, val)        atomic_add_((ptr), (LONG64)(val), sizeof(*(ptr)))
+#define ATOMIC_SUB(ptr, val)        atomic_add_((ptr), -(LONG64)(val), sizeof(*(ptr)))
+#define ATOMIC_XCHG(ptr, val)       atomic_xchg_((ptr), (LONG64)(val), sizeof(*(ptr)))
+#define ATOMIC_CAS(ptr, oldp, val)  atomic_cas_((ptr), (oldp), (LONG64)(val), sizeof(*(ptr)))
+#define ATOMIC_FENCE()              MemoryBarrier()
+#endif
+
+/**
+* Hint to cpu that caller is spinning, saves power and lets sibling
+* hyper thread run
+*/
+#ifndef _WIN32
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+#else
+#define CPU_RELAX() YieldProcessor()
+#endif
+
+/**
+* Size of cache line, used to pad data written by different threads
+*/
+#define CACHE_LINE_SIZE 64
+
 /******************************************/
 /****************  enum  ******************/
 /******************************************/